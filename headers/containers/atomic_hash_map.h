@@ -0,0 +1,19 @@
+#pragma once
+
+#include "shared_ptr.h"
+
+/* Type declaration */
+/* Concurrent uint64_t -> fixed-size value map built on per-slot CAS. It is not lock-free:
+   a value write holds its slot in a writing state, and readers, writers and resize helpers
+   that reach such a slot (or wait for the last migration chunk) yield until it is released,
+   so a preempted writer or migrator stalls the threads behind it */
+typedef shared_ptr atomic_hash_map;
+
+/* Main function's declarations */
+atomic_hash_map create_atomic_hash_map(const size_t size, const size_t value_size);
+void free_atomic_hash_map(atomic_hash_map const m);
+int set_atomic_hash_map(atomic_hash_map const m, const uint64_t key, const void *const val);
+int get_atomic_hash_map(const atomic_hash_map m, const uint64_t key, void *const val);
+int delete_atomic_hash_map(atomic_hash_map const m, const uint64_t key, void *const val);
+int has_key_atomic_hash_map(const atomic_hash_map m, const uint64_t key);
+size_t count_atomic_hash_map(const atomic_hash_map m);
@@ -0,0 +1,33 @@
+#pragma once
+#include "svo.h"
+
+#define BRICK_SIZE 8
+#define BRICK_VOXELS (BRICK_SIZE * BRICK_SIZE * BRICK_SIZE)
+
+typedef struct brick_t
+{
+    uint64_t occupancy[BRICK_VOXELS / 64];
+    uint32_t colors[BRICK_VOXELS];
+} brick_t;
+
+/* A separate type, not a mode of svo_t: brickmap_* mirrors the svo_get/svo_set/svo_unset/svo_ray_cast
+   signatures, so switching backends means switching the calls, there is no runtime dispatch */
+typedef struct brickmap_t
+{
+    uint32_t *index;
+    brick_t *bricks;
+    uint32_t *spare;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t spare_count;
+    const point_t extent;
+    const point_t size;
+} brickmap_t;
+
+brickmap_t brickmap(const point_t extent);
+void brickmap_clear(brickmap_t *const map);
+void brickmap_free(brickmap_t *const map);
+voxel_t brickmap_get(brickmap_t *const map, const point_t point);
+void brickmap_set(brickmap_t *const map, const point_t point, const color_t color);
+void brickmap_unset(brickmap_t *const map, const point_t point);
+ray_hit_t brickmap_ray_cast(const brickmap_t *const map, const point_t start, const point_t end, const float max_dist);
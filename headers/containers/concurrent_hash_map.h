@@ -0,0 +1,16 @@
+#pragma once
+
+#include "hash_map.h"
+
+/* Type declaration */
+typedef shared_ptr concurrent_hash_map;
+
+/* Main function's declarations */
+concurrent_hash_map create_concurrent_hash_map(const size_t size, const size_t shards, const type_func *const keys_type, const type_func *const container_type);
+void free_concurrent_hash_map(concurrent_hash_map const m);
+int set_concurrent_hash_map(concurrent_hash_map const m, const void *const key, const void *const val);
+int get_concurrent_hash_map(const concurrent_hash_map m, const void *const key, void *const val);
+int delete_concurrent_hash_map(concurrent_hash_map const m, const void *const key, void *const val);
+int has_key_concurrent_hash_map(const concurrent_hash_map m, const void *const key);
+size_t count_concurrent_hash_map(const concurrent_hash_map m);
+int for_each_concurrent_hash_map(const concurrent_hash_map m, hash_map_func func, void *const context);
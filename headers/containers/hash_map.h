@@ -2,14 +2,52 @@
 
 #include "type_functionality.h"
 #include "shared_ptr.h"
+#include "vector.h"
 
 /* Type declaration */
 typedef shared_ptr hash_map;
 
+typedef struct hash_map_stats_t
+{
+    size_t count;
+    size_t size;
+    size_t tombstones;
+    float load_factor;
+    float max_load_factor;
+    float average_probe;
+    size_t max_probe;
+} hash_map_stats_t;
+
+/* Zero-initialize before the first next_hash_map call */
+typedef struct hash_map_iter_t
+{
+    size_t table;
+    size_t index;
+} hash_map_iter_t;
+
+typedef void (*hash_map_func)(const void *const key, void *const val, void *const context);
+
 /* Main function's declarations */
 hash_map create_hash_map(const size_t size, const type_func *const keys_type, const type_func *const container_type);
 void free_hash_map(hash_map const m);
 int set_hash_map(hash_map const m, const void *const key, const void *const val);
+int emplace_hash_map(hash_map const m, const void *const key, void **const ref);
 int get_hash_map(const hash_map m, const void *const key, void *const val);
+int get_many_hash_map(const hash_map m, const void *const keys, const size_t n, void *const vals, int *const found);
+/* Writable pointer to the value; fails with *ref = NULL on a read-only map_hash_map map (use get_hash_map) */
+int get_ref_hash_map(const hash_map m, const void *const key, void **const ref);
+int get_str_hash_map(const hash_map m, const char *const key, const size_t len, void *const val);
 int delete_hash_map(hash_map const m, const void *const key, void *const val);
 int has_key_hash_map(const hash_map m, const void *const key);
+size_t count_hash_map(const hash_map m);
+const type_func *keys_type_hash_map(const hash_map m);
+int has_key_str_hash_map(const hash_map m, const char *const key, const size_t len);
+int set_max_load_factor_hash_map(hash_map const m, const float max_load_factor);
+int reserve_hash_map(hash_map const m, const size_t count);
+int set_incremental_hash_map(hash_map const m, const int incremental);
+int set_cache_hashes_hash_map(hash_map const m, const int cache_hashes);
+int set_robin_hood_hash_map(hash_map const m, const int robin_hood);
+int next_hash_map(const hash_map m, hash_map_iter_t *const it, void **const key, void **const val);
+int for_each_hash_map(const hash_map m, hash_map_func func, void *const context);
+int export_hash_map(const hash_map m, vector const keys, vector const values);
+hash_map_stats_t stats_hash_map(const hash_map m);
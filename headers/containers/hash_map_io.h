@@ -0,0 +1,7 @@
+#pragma once
+
+#include "hash_map.h"
+
+/* Main function's declarations */
+int save_hash_map(hash_map const m, const char *const path);
+hash_map map_hash_map(const char *const path, const type_func *const keys_type, const type_func *const container_type, const int writable);
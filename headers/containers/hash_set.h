@@ -0,0 +1,25 @@
+#pragma once
+
+#include "hash_map.h"
+
+/* Type declaration */
+typedef shared_ptr hash_set;
+
+/* Zero-initialize before the first next_hash_set call */
+typedef hash_map_iter_t hash_set_iter_t;
+
+typedef void (*hash_set_func)(const void *const key, void *const context);
+
+/* Main function's declarations */
+hash_set create_hash_set(const size_t size, const type_func *const keys_type);
+void free_hash_set(hash_set const s);
+int insert_hash_set(hash_set const s, const void *const key);
+int contains_hash_set(const hash_set s, const void *const key);
+int erase_hash_set(hash_set const s, const void *const key);
+size_t count_hash_set(const hash_set s);
+int reserve_hash_set(hash_set const s, const size_t count);
+int next_hash_set(const hash_set s, hash_set_iter_t *const it, void **const key);
+int for_each_hash_set(const hash_set s, hash_set_func func, void *const context);
+int export_hash_set(const hash_set s, vector const keys);
+hash_set union_hash_set(const hash_set a, const hash_set b);
+hash_set intersect_hash_set(const hash_set a, const hash_set b);
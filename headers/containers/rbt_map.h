@@ -11,7 +11,9 @@ rbt_map create_rbt_map(const size_t size, const type_func *keys_type, const type
 void free_rbt_map(rbt_map const tree);
 int set_rbt_map(rbt_map const m, const void *const key, const void *const val);
 int has_key_rbt_map(const rbt_map m, const void *const key);
+int has_key_str_rbt_map(const rbt_map m, const char *const key, const size_t len);
 int get_rbt_map(const rbt_map m, const void *const key, void *const val);
+int get_str_rbt_map(const rbt_map m, const char *const key, const size_t len, void *const val);
 int delete_rbt_map(rbt_map const m, const void *const key, void *const val);
 int get_min_rbt_map(const rbt_map m, void *const key, void *const val);
 int get_max_rbt_map(const rbt_map m, void *const key, void *const val);
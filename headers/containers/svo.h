@@ -1,6 +1,24 @@
 #pragma once
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+
+#ifdef SVO_WIDE_INDEX
+typedef uint64_t svo_index_t;
+#ifndef SVO_MAX_DEPTH
+#define SVO_MAX_DEPTH 14
+#endif // SVO_MAX_DEPTH
+#else
+typedef uint32_t svo_index_t;
+#ifndef SVO_MAX_DEPTH
+#define SVO_MAX_DEPTH 10
+#endif // SVO_MAX_DEPTH
+#endif // SVO_WIDE_INDEX
+
+static_assert(SVO_MAX_DEPTH > 0 && SVO_MAX_DEPTH <= 30, "SVO_MAX_DEPTH must be in [1, 30]");
+
+#define SVO_QUERY_WINDOW 1024
 
 typedef union point_t
 {
@@ -41,28 +59,114 @@ typedef struct ray_hit_t
 
 typedef struct svo_queue_t
 {
-    uint32_t *queue;
-    uint32_t count;
-    uint32_t offset;
-    uint32_t capacity;
+    svo_index_t *queue;
+    svo_index_t count;
+    svo_index_t offset;
+    svo_index_t capacity;
 } svo_queue_t;
 
 typedef struct svo_nodes_t
 {
-    uint32_t *iroot;
+    svo_index_t *iroot;
     uint32_t *croot;
-    uint32_t count;
-    uint32_t capacity;
+    uint8_t *droot;
+    uint64_t *hroot;
+    svo_index_t count;
+    svo_index_t capacity;
 } svo_nodes_t;
 
+typedef struct svo_edit_t
+{
+    svo_index_t index;
+    uint8_t type;
+} svo_edit_t;
+
+typedef struct svo_block_t
+{
+    uint64_t hroot[8];
+    svo_index_t iroot[8];
+    uint32_t croot[8];
+    uint8_t droot[8];
+} svo_block_t;
+
+/* Every edit is a small record; only block edits also push the replaced block to blocks */
+typedef struct svo_journal_t
+{
+    svo_edit_t *edits;
+    svo_index_t count;
+    svo_index_t capacity;
+    svo_block_t *blocks;
+    svo_index_t block_count;
+    svo_index_t block_capacity;
+    svo_index_t *strokes;
+    uint32_t stroke_count;
+    uint32_t stroke_capacity;
+} svo_journal_t;
+
+typedef struct svo_history_t
+{
+    svo_journal_t undo;
+    svo_journal_t redo;
+    svo_index_t *seen;
+    svo_index_t seen_count;
+    svo_index_t seen_capacity;
+    uint32_t depth;
+    bool enabled;
+} svo_history_t;
+
+typedef struct svo_counters_t
+{
+    uint64_t sets;
+    uint64_t unsets;
+    uint64_t splits;
+    uint64_t collapses;
+} svo_counters_t;
+
+typedef struct svo_queries_t
+{
+    uint32_t count;
+    uint32_t depth_sum;
+} svo_queries_t;
+
+typedef struct svo_level_stats_t
+{
+    svo_index_t empty;
+    svo_index_t leaves;
+    svo_index_t nodes;
+} svo_level_stats_t;
+
+typedef struct svo_stats_t
+{
+    svo_level_stats_t levels[SVO_MAX_DEPTH + 1];
+    svo_index_t empty;
+    svo_index_t leaves;
+    svo_index_t nodes;
+    svo_index_t spare;
+    svo_index_t count;
+    svo_index_t capacity;
+    float fill_ratio;
+    size_t bytes;
+    float average_depth;
+    svo_counters_t counters;
+} svo_stats_t;
+
 typedef struct svo_t
 {
     svo_nodes_t nodes;
     svo_queue_t spare;
+    svo_queries_t queries;
+    svo_history_t history;
+    /* Always laid out; queries and counters only move in SVO_COUNTERS builds,
+       where svo_get also writes them and concurrent readers need a lock */
+    svo_counters_t counters;
+    const point_t extent;
     const uint32_t grid_size;
     const uint32_t max_depth;
+    uint8_t max_distance;
 } svo_t;
 
+typedef void (*svo_walk_func)(const voxel_t *const voxel, void *const context);
+
 #define POINT(X, Y, Z) \
     (point_t) { .x = X, .y = Y, .z = Z }
 #define COLOR(R, G, B, A) \
@@ -73,12 +177,29 @@ typedef struct svo_t
     (voxel_t) { .aabb = A, .color = C }
 
 svo_t svo(const uint32_t grid_size, const uint32_t min_size);
+svo_t svo_box(const point_t extent, const uint32_t min_size);
 void svo_clear(svo_t *const svo);
 void svo_free(svo_t *const svo);
 void svo_adjust(svo_t *const svo);
 voxel_t svo_get(svo_t *const svo, const point_t point);
 void svo_set(svo_t *const svo, const point_t point, const color_t color);
+void svo_fill(svo_t *const svo, const aabb_t aabb, const color_t color);
 void svo_unset(svo_t *const svo, const point_t point);
 void svo_optimize(svo_t *const svo);
 void svo_print(svo_t *const svo);
-// ray_hit_t svo_ray_cast(const svo_t *const ot, const point_t start, const point_t end, const float max_dist);
+svo_stats_t svo_stats(const svo_t *const svo);
+void svo_walk(const svo_t *const svo, svo_walk_func walk_func, void *const context);
+void svo_enable_distance(svo_t *const svo, const uint8_t max_distance);
+void svo_disable_distance(svo_t *const svo);
+uint32_t svo_distance(const svo_t *const svo, const point_t point);
+void svo_enable_hashes(svo_t *const svo);
+void svo_disable_hashes(svo_t *const svo);
+uint64_t svo_hash(const svo_t *const svo, const aabb_t aabb);
+void svo_enable_history(svo_t *const svo);
+void svo_disable_history(svo_t *const svo);
+void svo_begin_edit(svo_t *const svo);
+void svo_end_edit(svo_t *const svo);
+bool svo_undo(svo_t *const svo);
+bool svo_redo(svo_t *const svo);
+ray_hit_t svo_ray_trace(const svo_t *const svo, const float *const origin, const float *const direction, const float max_dist);
+ray_hit_t svo_ray_cast(const svo_t *const svo, const point_t start, const point_t end, const float max_dist);
@@ -0,0 +1,18 @@
+#pragma once
+#include "svo.h"
+
+typedef struct svo_bake_attribute_t
+{
+    float occlusion;
+    float sky;
+} svo_bake_attribute_t;
+
+typedef struct svo_bake_t
+{
+    voxel_t *leaves;
+    svo_bake_attribute_t *attributes;
+    uint32_t count;
+} svo_bake_t;
+
+svo_bake_t svo_bake(const svo_t *const svo, const uint32_t samples, const float radius, const uint32_t threads);
+void svo_bake_free(svo_bake_t *const bake);
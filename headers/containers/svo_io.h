@@ -0,0 +1,9 @@
+#pragma once
+#include "svo.h"
+
+bool svo_vox_extent(const char *const path, point_t *const extent);
+bool svo_import_vox(svo_t *const svo, const char *const path);
+bool svo_export_vox(const svo_t *const svo, const char *const path);
+/* Fails without reading if the raw grid extent does not fit inside svo->extent */
+bool svo_import_raw(svo_t *const svo, const char *const path, const point_t extent);
+bool svo_export_raw(const svo_t *const svo, const char *const path);
@@ -0,0 +1,14 @@
+#pragma once
+#include "svo.h"
+
+typedef struct triangle_t
+{
+    float vertices[3][3];
+    color_t color;
+} triangle_t;
+
+void svo_voxelize(svo_t *const svo,
+                  const triangle_t *const triangles,
+                  const uint32_t count,
+                  const bool fill_solid,
+                  const color_t fill_color);
@@ -3,6 +3,15 @@
 
 typedef shared_ptr string_t;
 
+/* Borrowed, not necessarily '\0'-terminated characters for lookups */
+typedef struct string_view_t
+{
+    const char *str;
+    size_t len;
+} string_view_t;
+
 string_t create_string(const char *const str);
 char * get_string(string_t const str);
-void free_string(string_t const str);
\ No newline at end of file
+void free_string(string_t const str);
+int cmp_string_view(const void *const str, const void *const view);
+size_t hash_string_view(const string_view_t *const view);
\ No newline at end of file
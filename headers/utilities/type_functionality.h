@@ -12,6 +12,8 @@ typedef struct type_func
     void (*t_free)(void *const);
     size_t (*t_hash)(const void *const);
     void (*t_swap)(void *const, void *const);
+    /* Optional keyed hash; containers with a per-instance seed prefer it over t_hash */
+    size_t (*t_hash_seed)(const void *const, const size_t);
 } type_func;
 
 extern const type_func *f_uint8_t;
@@ -10,3 +10,9 @@ size_t hash_32bit(uint32_t x);
 size_t hash_64bit(uint64_t x);
 size_t hash_size_t(size_t x);
 size_t hash_string_t(const char *key);
+size_t hash_string_len(const char *key, const size_t len);
+uint64_t hash_bytes(const void *const key, const size_t len, uint64_t seed);
+void set_hash_seed(const uint64_t seed);
+size_t random_hash_seed(void);
+void *aligned_malloc(const size_t alignment, const size_t size);
+void aligned_free(void *const ptr);
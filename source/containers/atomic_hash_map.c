@@ -0,0 +1,578 @@
+#include "atomic_hash_map.h"
+#include "util_funcs.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#define ATOMIC_HASH_MAP_MIN_SIZE 64
+#define MIGRATE_CHUNK 1024
+#define READER_STRIPES 32
+#define CACHE_LINE 64
+
+/* Slot state: low 3 bits are the kind, the rest is a version bumped on every value write */
+#define SLOT_EMPTY 0
+#define SLOT_RESERVED 1
+#define SLOT_FULL 2
+#define SLOT_WRITING 3
+#define SLOT_DELETED 4
+#define SLOT_COPYING 5
+#define SLOT_MOVED 6
+#define SLOT_MIGRATED 7
+#define SLOT_KIND(state) ((state)&7)
+#define SLOT_VERSION(state) ((state) & ~(uint64_t)7)
+#define SLOT_NEXT_VERSION(state) (SLOT_VERSION(state) + 8)
+
+#define RESULT_MISSING 0
+#define RESULT_DONE 1
+#define RESULT_RETRY 2
+
+/* Struct's declarations */
+typedef struct slot_t
+{
+    uint64_t state;
+    uint64_t key;
+} slot_t;
+
+typedef struct table_t
+{
+    size_t size;
+    size_t used;
+    size_t cursor;
+    size_t copied;
+    struct table_t *next;
+    struct table_t *retired;
+    uint64_t retire_epoch;
+    slot_t *slots;
+    uint64_t *values;
+} table_t;
+
+/* Operations in flight per epoch parity; threads spread over stripes to avoid one hot line */
+typedef struct stripe_t
+{
+    size_t active[2];
+} __attribute__((aligned(CACHE_LINE))) stripe_t;
+
+typedef struct atomic_hash_map_t
+{
+    table_t *root;
+    table_t *retired;
+    uint64_t epoch;
+    int reclaiming;
+    stripe_t *stripes;
+    size_t count;
+    uint64_t seed;
+    size_t value_size;
+    size_t value_words;
+} atomic_hash_map_t;
+
+/* Static function's declarations */
+static table_t *create_table_atomic_hash_map(const size_t size, const size_t value_words);
+static void free_table_atomic_hash_map(table_t *const t);
+static int set_table_atomic_hash_map(atomic_hash_map_t *const m, table_t *const t, const uint64_t key, const void *const val);
+static int delete_table_atomic_hash_map(atomic_hash_map_t *const m, table_t *const t, const uint64_t key, void *const val);
+static int start_resize_atomic_hash_map(atomic_hash_map_t *const m, table_t *const t);
+static void help_resize_atomic_hash_map(atomic_hash_map_t *const m, table_t *const t);
+static void migrate_slot_atomic_hash_map(const atomic_hash_map_t *const m, table_t *const t, const size_t index);
+static void read_value_atomic_hash_map(const atomic_hash_map_t *const m, const uint64_t *const src, void *const dest);
+static void write_value_atomic_hash_map(const atomic_hash_map_t *const m, uint64_t *const dest, const void *const src);
+static inline int claim_slot_atomic_hash_map(slot_t *const slot, uint64_t *const state, const uint64_t kind);
+static inline stripe_t *get_stripe_atomic_hash_map(const atomic_hash_map_t *const m);
+static size_t enter_atomic_hash_map(atomic_hash_map_t *const m);
+static void leave_atomic_hash_map(atomic_hash_map_t *const m, const size_t parity);
+static void retire_table_atomic_hash_map(atomic_hash_map_t *const m, table_t *const t);
+static void push_retired_atomic_hash_map(atomic_hash_map_t *const m, table_t *const t);
+static void reclaim_atomic_hash_map(atomic_hash_map_t *const m);
+
+/* Main functions */
+atomic_hash_map create_atomic_hash_map(const size_t size, const size_t value_size)
+{
+    atomic_hash_map ptr = malloc_shared_ptr(1, sizeof(atomic_hash_map_t));
+    if (ptr == NULL)
+        return NULL;
+    size_t mul_of_2_size = size * 2 < ATOMIC_HASH_MAP_MIN_SIZE ? ATOMIC_HASH_MAP_MIN_SIZE : next_power_of_2(size * 2);
+    atomic_hash_map_t new_m = {
+        .retired = NULL,
+        .epoch = 0,
+        .reclaiming = 0,
+        .stripes = aligned_malloc(CACHE_LINE, READER_STRIPES * sizeof(stripe_t)),
+        .count = 0,
+        .seed = random_hash_seed(),
+        .value_size = value_size,
+        .value_words = (value_size + sizeof(uint64_t) - 1) / sizeof(uint64_t)};
+    new_m.root = create_table_atomic_hash_map(mul_of_2_size, new_m.value_words);
+    if (new_m.root == NULL || new_m.stripes == NULL)
+    {
+        if (new_m.root != NULL)
+            free_table_atomic_hash_map(new_m.root);
+        aligned_free(new_m.stripes);
+        free_shared_ptr(ptr);
+        return NULL;
+    }
+    memset(new_m.stripes, 0, READER_STRIPES * sizeof(stripe_t));
+    memcpy(data_shared_ptr(ptr), &new_m, sizeof(atomic_hash_map_t));
+    return ptr;
+}
+
+void free_atomic_hash_map(atomic_hash_map const ptr)
+{
+    if (ptr == NULL)
+        return;
+    if (count_shared_ptr(ptr) == 1)
+    {
+        atomic_hash_map_t *m = data_shared_ptr(ptr);
+        if (m->root->next != NULL)
+            free_table_atomic_hash_map(m->root->next);
+        free_table_atomic_hash_map(m->root);
+        while (m->retired != NULL)
+        {
+            table_t *retired = m->retired->retired;
+            free_table_atomic_hash_map(m->retired);
+            m->retired = retired;
+        }
+        aligned_free(m->stripes);
+        m->count = 0;
+    }
+    free_shared_ptr(ptr);
+    return;
+}
+
+int set_atomic_hash_map(atomic_hash_map const ptr, const uint64_t key, const void *const val)
+{
+    if (ptr == NULL)
+        return 0;
+    atomic_hash_map_t *m = data_shared_ptr(ptr);
+    if (val == NULL)
+        return 0;
+    size_t parity = enter_atomic_hash_map(m);
+    int result = 1;
+    for (;;)
+    {
+        table_t *t = __atomic_load_n(&m->root, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&t->next, __ATOMIC_ACQUIRE) == NULL &&
+            set_table_atomic_hash_map(m, t, key, val) == RESULT_DONE)
+            break;
+        if (start_resize_atomic_hash_map(m, t) == 0)
+        {
+            result = 0;
+            break;
+        }
+        help_resize_atomic_hash_map(m, t);
+    }
+    leave_atomic_hash_map(m, parity);
+    reclaim_atomic_hash_map(m);
+    return result;
+}
+
+int get_atomic_hash_map(const atomic_hash_map ptr, const uint64_t key, void *const val)
+{
+    if (ptr == NULL)
+        return 0;
+    atomic_hash_map_t *m = data_shared_ptr(ptr);
+    size_t parity = enter_atomic_hash_map(m);
+    table_t *t = __atomic_load_n(&m->root, __ATOMIC_SEQ_CST);
+    size_t mask = t->size - 1;
+    size_t index = hash_64bit(key ^ m->seed) & mask;
+    size_t probes = 0;
+    int result = 0;
+    while (probes < t->size)
+    {
+        slot_t *slot = t->slots + index;
+        uint64_t state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+        uint64_t kind = SLOT_KIND(state);
+        if (kind == SLOT_EMPTY)
+            break;
+        if (kind == SLOT_RESERVED || kind == SLOT_MOVED ||
+            __atomic_load_n(&slot->key, __ATOMIC_RELAXED) != key)
+        {
+            index = (index + 1) & mask;
+            probes++;
+        }
+        else if (kind == SLOT_MIGRATED)
+        {
+            /* Already copied: the newer table holds the current value */
+            t = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+            mask = t->size - 1;
+            index = hash_64bit(key ^ m->seed) & mask;
+            probes = 0;
+        }
+        else if (kind == SLOT_DELETED)
+        {
+            break;
+        }
+        else if (kind == SLOT_WRITING)
+        {
+            sched_yield();
+        }
+        else
+        {
+            if (val != NULL)
+                read_value_atomic_hash_map(m, t->values + index * m->value_words, val);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&slot->state, __ATOMIC_RELAXED) == state)
+            {
+                result = 1;
+                break;
+            }
+        }
+    }
+    leave_atomic_hash_map(m, parity);
+    return result;
+}
+
+int delete_atomic_hash_map(atomic_hash_map const ptr, const uint64_t key, void *const val)
+{
+    if (ptr == NULL)
+        return 0;
+    atomic_hash_map_t *m = data_shared_ptr(ptr);
+    size_t parity = enter_atomic_hash_map(m);
+    int result = RESULT_MISSING;
+    for (;;)
+    {
+        table_t *t = __atomic_load_n(&m->root, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&t->next, __ATOMIC_ACQUIRE) == NULL)
+        {
+            result = delete_table_atomic_hash_map(m, t, key, val);
+            if (result != RESULT_RETRY)
+                break;
+        }
+        if (start_resize_atomic_hash_map(m, t) == 0)
+        {
+            result = 0;
+            break;
+        }
+        help_resize_atomic_hash_map(m, t);
+    }
+    leave_atomic_hash_map(m, parity);
+    reclaim_atomic_hash_map(m);
+    return result;
+}
+
+int has_key_atomic_hash_map(const atomic_hash_map ptr, const uint64_t key)
+{
+    return get_atomic_hash_map(ptr, key, NULL);
+}
+
+size_t count_atomic_hash_map(const atomic_hash_map ptr)
+{
+    if (ptr == NULL)
+        return 0;
+    atomic_hash_map_t *m = data_shared_ptr(ptr);
+    return __atomic_load_n(&m->count, __ATOMIC_RELAXED);
+}
+
+/* Static functions */
+static table_t *create_table_atomic_hash_map(const size_t size, const size_t value_words)
+{
+    table_t *t = calloc(1, sizeof(table_t));
+    if (t == NULL)
+        return NULL;
+    t->size = size;
+    t->slots = calloc(size, sizeof(slot_t));
+    t->values = calloc(size * value_words + 1, sizeof(uint64_t));
+    if (t->slots == NULL || t->values == NULL)
+    {
+        free_table_atomic_hash_map(t);
+        return NULL;
+    }
+    return t;
+}
+
+static void free_table_atomic_hash_map(table_t *const t)
+{
+    free(t->slots);
+    free(t->values);
+    free(t);
+    return;
+}
+
+static int set_table_atomic_hash_map(atomic_hash_map_t *const m, table_t *const t, const uint64_t key, const void *const val)
+{
+    const size_t mask = t->size - 1;
+    size_t index = hash_64bit(key ^ m->seed) & mask;
+    size_t probes = 0;
+    while (probes < t->size)
+    {
+        slot_t *slot = t->slots + index;
+        uint64_t state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+        uint64_t kind = SLOT_KIND(state);
+        if (kind == SLOT_EMPTY)
+        {
+            if (claim_slot_atomic_hash_map(slot, &state, SLOT_RESERVED) == 0)
+                continue;
+            __atomic_store_n(&slot->key, key, __ATOMIC_RELAXED);
+            write_value_atomic_hash_map(m, t->values + index * m->value_words, val);
+            __atomic_store_n(&slot->state, SLOT_NEXT_VERSION(state) | SLOT_FULL, __ATOMIC_RELEASE);
+            __atomic_add_fetch(&m->count, 1, __ATOMIC_RELAXED);
+            /* Keep a quarter of the slots free so probe chains stay short */
+            if (__atomic_add_fetch(&t->used, 1, __ATOMIC_RELAXED) > t->size - t->size / 4)
+                start_resize_atomic_hash_map(m, t);
+            return RESULT_DONE;
+        }
+        if (kind == SLOT_RESERVED || kind == SLOT_WRITING)
+        {
+            sched_yield();
+        }
+        else if (kind == SLOT_COPYING || kind == SLOT_MOVED || kind == SLOT_MIGRATED)
+        {
+            return RESULT_RETRY;
+        }
+        else if (__atomic_load_n(&slot->key, __ATOMIC_RELAXED) != key)
+        {
+            index = (index + 1) & mask;
+            probes++;
+        }
+        else if (claim_slot_atomic_hash_map(slot, &state, SLOT_WRITING))
+        {
+            /* Deleted slots keep their key, so a re-insert revives the same slot */
+            write_value_atomic_hash_map(m, t->values + index * m->value_words, val);
+            __atomic_store_n(&slot->state, SLOT_NEXT_VERSION(state) | SLOT_FULL, __ATOMIC_RELEASE);
+            if (kind == SLOT_DELETED)
+                __atomic_add_fetch(&m->count, 1, __ATOMIC_RELAXED);
+            return RESULT_DONE;
+        }
+    }
+    return RESULT_RETRY;
+}
+
+static int delete_table_atomic_hash_map(atomic_hash_map_t *const m, table_t *const t, const uint64_t key, void *const val)
+{
+    const size_t mask = t->size - 1;
+    size_t index = hash_64bit(key ^ m->seed) & mask;
+    size_t probes = 0;
+    while (probes < t->size)
+    {
+        slot_t *slot = t->slots + index;
+        uint64_t state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+        uint64_t kind = SLOT_KIND(state);
+        if (kind == SLOT_EMPTY)
+            return RESULT_MISSING;
+        if (kind == SLOT_RESERVED || kind == SLOT_WRITING)
+        {
+            sched_yield();
+        }
+        else if (kind == SLOT_COPYING || kind == SLOT_MOVED || kind == SLOT_MIGRATED)
+        {
+            return RESULT_RETRY;
+        }
+        else if (__atomic_load_n(&slot->key, __ATOMIC_RELAXED) != key)
+        {
+            index = (index + 1) & mask;
+            probes++;
+        }
+        else if (kind == SLOT_DELETED)
+        {
+            return RESULT_MISSING;
+        }
+        else if (claim_slot_atomic_hash_map(slot, &state, SLOT_WRITING))
+        {
+            if (val != NULL)
+                read_value_atomic_hash_map(m, t->values + index * m->value_words, val);
+            __atomic_store_n(&slot->state, SLOT_NEXT_VERSION(state) | SLOT_DELETED, __ATOMIC_RELEASE);
+            __atomic_sub_fetch(&m->count, 1, __ATOMIC_RELAXED);
+            return RESULT_DONE;
+        }
+    }
+    return RESULT_MISSING;
+}
+
+/* Returns 0 only if a needed table could not be allocated */
+static int start_resize_atomic_hash_map(atomic_hash_map_t *const m, table_t *const t)
+{
+    if (__atomic_load_n(&t->next, __ATOMIC_ACQUIRE) != NULL)
+        return 1;
+    /* Mostly tombstones: rehash at the same size instead of doubling */
+    size_t count = __atomic_load_n(&m->count, __ATOMIC_RELAXED);
+    size_t new_size = count >= t->size / 4 ? t->size << 1 : t->size;
+    table_t *next = create_table_atomic_hash_map(new_size, m->value_words);
+    if (next == NULL)
+        return 0;
+    table_t *expected = NULL;
+    if (__atomic_compare_exchange_n(&t->next, &expected, next, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) == 0)
+        free_table_atomic_hash_map(next);
+    return 1;
+}
+
+/* Every writer that runs into a resize copies chunks until the table is drained */
+static void help_resize_atomic_hash_map(atomic_hash_map_t *const m, table_t *const t)
+{
+    table_t *next = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+    size_t start = 0;
+    while ((start = __atomic_fetch_add(&t->cursor, MIGRATE_CHUNK, __ATOMIC_RELAXED)) < t->size)
+    {
+        size_t end = start + MIGRATE_CHUNK < t->size ? start + MIGRATE_CHUNK : t->size;
+        size_t i = start;
+        for (; i < end; i++)
+        {
+            migrate_slot_atomic_hash_map(m, t, i);
+        }
+        if (__atomic_add_fetch(&t->copied, end - start, __ATOMIC_ACQ_REL) == t->size)
+        {
+            __atomic_store_n(&m->root, next, __ATOMIC_SEQ_CST);
+            retire_table_atomic_hash_map(m, t);
+        }
+    }
+    while (__atomic_load_n(&m->root, __ATOMIC_ACQUIRE) == t)
+        sched_yield();
+    return;
+}
+
+static void migrate_slot_atomic_hash_map(const atomic_hash_map_t *const m, table_t *const t, const size_t index)
+{
+    slot_t *slot = t->slots + index;
+    uint64_t state = 0;
+    for (;;)
+    {
+        state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+        uint64_t kind = SLOT_KIND(state);
+        if (kind == SLOT_EMPTY || kind == SLOT_DELETED)
+        {
+            if (claim_slot_atomic_hash_map(slot, &state, SLOT_MOVED))
+                return;
+        }
+        else if (kind == SLOT_FULL)
+        {
+            if (claim_slot_atomic_hash_map(slot, &state, SLOT_COPYING))
+                break;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+    /* Keys are unique, so any claimed slot in the new table belongs to another key */
+    table_t *next = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+    const uint64_t key = __atomic_load_n(&slot->key, __ATOMIC_RELAXED);
+    const size_t mask = next->size - 1;
+    size_t i = hash_64bit(key ^ m->seed) & mask;
+    for (;;)
+    {
+        uint64_t empty = SLOT_EMPTY;
+        if (claim_slot_atomic_hash_map(next->slots + i, &empty, SLOT_RESERVED))
+            break;
+        i = (i + 1) & mask;
+    }
+    __atomic_store_n(&next->slots[i].key, key, __ATOMIC_RELAXED);
+    size_t w = 0;
+    for (; w < m->value_words; w++)
+    {
+        __atomic_store_n(next->values + i * m->value_words + w,
+                         __atomic_load_n(t->values + index * m->value_words + w, __ATOMIC_RELAXED),
+                         __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&next->slots[i].state, (uint64_t)SLOT_FULL, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&next->used, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->state, SLOT_NEXT_VERSION(state) | SLOT_MIGRATED, __ATOMIC_RELEASE);
+    return;
+}
+
+static void read_value_atomic_hash_map(const atomic_hash_map_t *const m, const uint64_t *const src, void *const dest)
+{
+    size_t w = 0;
+    for (; w < m->value_words; w++)
+    {
+        uint64_t word = __atomic_load_n(src + w, __ATOMIC_RELAXED);
+        size_t offset = w * sizeof(uint64_t);
+        memcpy((uint8_t *)dest + offset, &word, m->value_size - offset < sizeof(uint64_t) ? m->value_size - offset : sizeof(uint64_t));
+    }
+    return;
+}
+
+static void write_value_atomic_hash_map(const atomic_hash_map_t *const m, uint64_t *const dest, const void *const src)
+{
+    size_t w = 0;
+    for (; w < m->value_words; w++)
+    {
+        uint64_t word = 0;
+        size_t offset = w * sizeof(uint64_t);
+        memcpy(&word, (const uint8_t *)src + offset, m->value_size - offset < sizeof(uint64_t) ? m->value_size - offset : sizeof(uint64_t));
+        __atomic_store_n(dest + w, word, __ATOMIC_RELAXED);
+    }
+    return;
+}
+
+/* CAS the slot from *state to the same version with a new kind; *state is refreshed on failure */
+static inline int claim_slot_atomic_hash_map(slot_t *const slot, uint64_t *const state, const uint64_t kind)
+{
+    return __atomic_compare_exchange_n(&slot->state, state, SLOT_VERSION(*state) | kind, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE);
+}
+
+static inline stripe_t *get_stripe_atomic_hash_map(const atomic_hash_map_t *const m)
+{
+    static size_t stripe_counter = 0;
+    static __thread size_t thread_stripe = 0;
+    if (thread_stripe == 0)
+        thread_stripe = __atomic_add_fetch(&stripe_counter, 1, __ATOMIC_RELAXED);
+    return m->stripes + thread_stripe % READER_STRIPES;
+}
+
+/* Pins the current epoch for one operation; returns the parity to pass to leave */
+static size_t enter_atomic_hash_map(atomic_hash_map_t *const m)
+{
+    stripe_t *stripe = get_stripe_atomic_hash_map(m);
+    for (;;)
+    {
+        uint64_t epoch = __atomic_load_n(&m->epoch, __ATOMIC_SEQ_CST);
+        size_t parity = epoch & 1;
+        __atomic_add_fetch(&stripe->active[parity], 1, __ATOMIC_SEQ_CST);
+        /* Only counts if the epoch did not move under us */
+        if (__atomic_load_n(&m->epoch, __ATOMIC_SEQ_CST) == epoch)
+            return parity;
+        __atomic_sub_fetch(&stripe->active[parity], 1, __ATOMIC_RELEASE);
+    }
+}
+
+static void leave_atomic_hash_map(atomic_hash_map_t *const m, const size_t parity)
+{
+    __atomic_sub_fetch(&get_stripe_atomic_hash_map(m)->active[parity], 1, __ATOMIC_RELEASE);
+    return;
+}
+
+/* Called once the root no longer points at t: only operations from this epoch or earlier can hold it */
+static void retire_table_atomic_hash_map(atomic_hash_map_t *const m, table_t *const t)
+{
+    t->retire_epoch = __atomic_load_n(&m->epoch, __ATOMIC_SEQ_CST);
+    push_retired_atomic_hash_map(m, t);
+    return;
+}
+
+static void push_retired_atomic_hash_map(atomic_hash_map_t *const m, table_t *const t)
+{
+    table_t *head = __atomic_load_n(&m->retired, __ATOMIC_RELAXED);
+    do
+    {
+        t->retired = head;
+    } while (__atomic_compare_exchange_n(&m->retired, &head, t, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED) == 0);
+    return;
+}
+
+/* Advances the epoch once the previous parity has drained; a table retired in epoch E
+   is freed from epoch E + 2, when every operation that could have seen it has left */
+static void reclaim_atomic_hash_map(atomic_hash_map_t *const m)
+{
+    if (__atomic_load_n(&m->retired, __ATOMIC_ACQUIRE) == NULL)
+        return;
+    int expected = 0;
+    if (__atomic_compare_exchange_n(&m->reclaiming, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) == 0)
+        return;
+    uint64_t epoch = __atomic_load_n(&m->epoch, __ATOMIC_SEQ_CST);
+    size_t active = 0;
+    size_t i = 0;
+    for (; i < READER_STRIPES; i++)
+    {
+        active += __atomic_load_n(&m->stripes[i].active[(epoch + 1) & 1], __ATOMIC_SEQ_CST);
+    }
+    if (active == 0)
+        __atomic_store_n(&m->epoch, ++epoch, __ATOMIC_SEQ_CST);
+    table_t *t = __atomic_exchange_n(&m->retired, NULL, __ATOMIC_ACQUIRE);
+    while (t != NULL)
+    {
+        table_t *retired = t->retired;
+        if (t->retire_epoch + 2 <= epoch)
+            free_table_atomic_hash_map(t);
+        else
+            push_retired_atomic_hash_map(m, t);
+        t = retired;
+    }
+    __atomic_store_n(&m->reclaiming, 0, __ATOMIC_RELEASE);
+    return;
+}
@@ -0,0 +1,215 @@
+#include "brickmap.h"
+#include "ray_march.h"
+#include <math.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BRICKS_START_CAPACITY 8
+
+#define INVALID_VOXEL VOXEL(AABB(POINT(-1, -1, -1), 0), COLOR(0, 0, 0, 0))
+
+static inline uint32_t bricks_per_axis(const int32_t extent)
+{
+    return ((uint32_t)extent + BRICK_SIZE - 1) / BRICK_SIZE;
+}
+
+brickmap_t brickmap(const point_t extent)
+{
+    assert(extent.x > 0 && extent.y > 0 && extent.z > 0);
+    const point_t size = POINT(bricks_per_axis(extent.x), bricks_per_axis(extent.y), bricks_per_axis(extent.z));
+    uint32_t *const index = calloc((size_t)size.x * size.y * size.z, sizeof(uint32_t));
+    assert(index != 0);
+    brick_t *const bricks = malloc(BRICKS_START_CAPACITY * sizeof(brick_t));
+    assert(bricks != 0);
+    uint32_t *const spare = malloc(BRICKS_START_CAPACITY * sizeof(uint32_t));
+    assert(spare != 0);
+    return (brickmap_t){.index = index,
+                        .bricks = bricks,
+                        .spare = spare,
+                        .count = 0,
+                        .capacity = BRICKS_START_CAPACITY,
+                        .spare_count = 0,
+                        .extent = extent,
+                        .size = size};
+}
+
+void brickmap_clear(brickmap_t *const map)
+{
+    memset(map->index, 0, (size_t)map->size.x * map->size.y * map->size.z * sizeof(uint32_t));
+    map->bricks = realloc(map->bricks, BRICKS_START_CAPACITY * sizeof(brick_t));
+    map->spare = realloc(map->spare, BRICKS_START_CAPACITY * sizeof(uint32_t));
+    map->count = 0;
+    map->capacity = BRICKS_START_CAPACITY;
+    map->spare_count = 0;
+    return;
+}
+
+void brickmap_free(brickmap_t *const map)
+{
+    free(map->index);
+    free(map->bricks);
+    free(map->spare);
+    return;
+}
+
+static inline bool is_in_grid(const brickmap_t *const map, const point_t *const point)
+{
+    return (uint32_t)point->x < (uint32_t)map->extent.x &&
+           (uint32_t)point->y < (uint32_t)map->extent.y &&
+           (uint32_t)point->z < (uint32_t)map->extent.z;
+}
+
+static inline size_t brick_slot(const brickmap_t *const map, const point_t *const point)
+{
+    return ((size_t)(point->x / BRICK_SIZE) * map->size.y + point->y / BRICK_SIZE) * map->size.z + point->z / BRICK_SIZE;
+}
+
+static inline uint32_t voxel_slot(const point_t *const point)
+{
+    return (point->x % BRICK_SIZE) * BRICK_SIZE * BRICK_SIZE + (point->y % BRICK_SIZE) * BRICK_SIZE + point->z % BRICK_SIZE;
+}
+
+static inline bool is_occupied(const brick_t *const brick, const uint32_t slot)
+{
+    return (brick->occupancy[slot / 64] >> (slot % 64)) & 1;
+}
+
+static inline bool is_brick_empty(const brick_t *const brick)
+{
+    uint64_t bits = 0;
+    int8_t i;
+    for (i = 0; i < BRICK_VOXELS / 64; i++)
+    {
+        bits |= brick->occupancy[i];
+    }
+    return bits == 0;
+}
+
+static inline uint32_t pack_color(const color_t color)
+{
+    return (uint32_t)color.r << 24 | color.g << 16 | color.b << 8 | color.a;
+}
+
+static inline color_t unpack_color(const uint32_t color)
+{
+    return COLOR((color >> 24) & 0xFF, (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF);
+}
+
+static inline uint32_t ask_for_brick(brickmap_t *const map)
+{
+    uint32_t brick;
+    if (map->spare_count != 0)
+    {
+        brick = map->spare[--map->spare_count];
+    }
+    else
+    {
+        if (map->count == map->capacity)
+        {
+            map->capacity *= 2;
+            map->bricks = realloc(map->bricks, map->capacity * sizeof(brick_t));
+            assert(map->bricks != 0);
+            map->spare = realloc(map->spare, map->capacity * sizeof(uint32_t));
+            assert(map->spare != 0);
+        }
+        brick = map->count++;
+    }
+    memset(map->bricks[brick].occupancy, 0, sizeof(map->bricks[brick].occupancy));
+    return brick;
+}
+
+voxel_t brickmap_get(brickmap_t *const map, const point_t point)
+{
+    if (is_in_grid(map, &point) == false)
+        return INVALID_VOXEL;
+    const uint32_t brick = map->index[brick_slot(map, &point)];
+    if (brick == 0)
+        return INVALID_VOXEL;
+    const brick_t *const data = map->bricks + brick - 1;
+    const uint32_t slot = voxel_slot(&point);
+    if (is_occupied(data, slot) == false)
+        return INVALID_VOXEL;
+    return VOXEL(AABB(point, 1), unpack_color(data->colors[slot]));
+}
+
+void brickmap_set(brickmap_t *const map, const point_t point, const color_t color)
+{
+    if (is_in_grid(map, &point) == false)
+        return;
+    uint32_t *const brick = map->index + brick_slot(map, &point);
+    if (*brick == 0)
+        *brick = ask_for_brick(map) + 1;
+    brick_t *const data = map->bricks + *brick - 1;
+    const uint32_t slot = voxel_slot(&point);
+    data->occupancy[slot / 64] |= (uint64_t)1 << (slot % 64);
+    data->colors[slot] = pack_color(color);
+    return;
+}
+
+void brickmap_unset(brickmap_t *const map, const point_t point)
+{
+    if (is_in_grid(map, &point) == false)
+        return;
+    uint32_t *const brick = map->index + brick_slot(map, &point);
+    if (*brick == 0)
+        return;
+    brick_t *const data = map->bricks + *brick - 1;
+    const uint32_t slot = voxel_slot(&point);
+    data->occupancy[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+    if (is_brick_empty(data) == true)
+    {
+        map->spare[map->spare_count++] = *brick - 1;
+        *brick = 0;
+    }
+    return;
+}
+
+ray_hit_t brickmap_ray_cast(const brickmap_t *const map, const point_t start, const point_t end, const float max_dist)
+{
+    ray_hit_t result = {.distance = __FLT_MAX__,
+                        .voxel = INVALID_VOXEL,
+                        .hit = false};
+    const double origin[3] = {start.x + 0.5, start.y + 0.5, start.z + 0.5};
+    double direction[3] = {(double)end.x - start.x, (double)end.y - start.y, (double)end.z - start.z};
+    if (direction[0] == 0.0 && direction[1] == 0.0 && direction[2] == 0.0)
+        direction[0] = 1.0;
+    ray_march_t ray = ray_march(origin, direction, map->extent, max_dist);
+    while (ray.t <= ray.t_max)
+    {
+        const point_t point = ray_march_point(&ray);
+        if (is_in_grid(map, &point) == false)
+            break;
+        const uint32_t brick = map->index[brick_slot(map, &point)];
+        double box_min[3], box_max[3];
+        double size;
+        if (brick == 0)
+        {
+            box_min[0] = point.x - point.x % BRICK_SIZE;
+            box_min[1] = point.y - point.y % BRICK_SIZE;
+            box_min[2] = point.z - point.z % BRICK_SIZE;
+            size = BRICK_SIZE;
+        }
+        else
+        {
+            const brick_t *const data = map->bricks + brick - 1;
+            const uint32_t slot = voxel_slot(&point);
+            if (is_occupied(data, slot) == true)
+            {
+                result.distance = ray.t;
+                result.voxel = VOXEL(AABB(point, 1), unpack_color(data->colors[slot]));
+                result.hit = true;
+                return result;
+            }
+            box_min[0] = point.x;
+            box_min[1] = point.y;
+            box_min[2] = point.z;
+            size = 1.0;
+        }
+        box_max[0] = box_min[0] + size;
+        box_max[1] = box_min[1] + size;
+        box_max[2] = box_min[2] + size;
+        ray_march_skip(&ray, box_min, box_max);
+    }
+    return result;
+}
@@ -0,0 +1,197 @@
+#include "concurrent_hash_map.h"
+#include "util_funcs.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define DEFAULT_SHARDS 64
+#define CACHE_LINE 64
+
+/* Struct's declarations */
+typedef struct shard_t
+{
+    pthread_rwlock_t lock;
+    hash_map map;
+    size_t count;
+} __attribute__((aligned(CACHE_LINE))) shard_t;
+
+typedef struct concurrent_hash_map_t
+{
+    size_t shard_count;
+    size_t shard_shift;
+    const type_func *keys_type;
+    const type_func *container_type;
+    shard_t *shards;
+} concurrent_hash_map_t;
+
+/* Static function's declarations */
+static inline shard_t *get_shard_concurrent_hash_map(const concurrent_hash_map_t *const m, const void *const key);
+static void free_shards_concurrent_hash_map(shard_t *const shards, const size_t count);
+
+/* Main functions */
+concurrent_hash_map create_concurrent_hash_map(const size_t size, const size_t shards, const type_func *const keys_type, const type_func *const container_type)
+{
+    concurrent_hash_map ptr = malloc_shared_ptr(1, sizeof(concurrent_hash_map_t));
+    if (ptr == NULL)
+        return NULL;
+    size_t shard_count = shards == 0 ? DEFAULT_SHARDS : shards == 1 ? 1 : next_power_of_2(shards);
+    size_t shard_bits = __builtin_ctzll(shard_count);
+    concurrent_hash_map_t new_m = {
+        .shard_count = shard_count,
+        .shard_shift = shard_bits == 0 ? 0 : sizeof(size_t) * 8 - shard_bits,
+        .keys_type = keys_type,
+        .container_type = container_type,
+        .shards = aligned_malloc(CACHE_LINE, shard_count * sizeof(shard_t))};
+    if (new_m.shards == NULL)
+    {
+        free_shared_ptr(ptr);
+        return NULL;
+    }
+    size_t i = 0;
+    for (; i < shard_count; i++)
+    {
+        new_m.shards[i].map = create_hash_map(size / shard_count, keys_type, container_type);
+        new_m.shards[i].count = 0;
+        if (new_m.shards[i].map == NULL || pthread_rwlock_init(&new_m.shards[i].lock, NULL) != 0)
+        {
+            free_hash_map(new_m.shards[i].map);
+            free_shards_concurrent_hash_map(new_m.shards, i);
+            free_shared_ptr(ptr);
+            return NULL;
+        }
+    }
+    memcpy(data_shared_ptr(ptr), &new_m, sizeof(concurrent_hash_map_t));
+    return ptr;
+}
+
+void free_concurrent_hash_map(concurrent_hash_map const ptr)
+{
+    if (ptr == NULL)
+        return;
+    if (count_shared_ptr(ptr) == 1)
+    {
+        concurrent_hash_map_t *m = data_shared_ptr(ptr);
+        free_shards_concurrent_hash_map(m->shards, m->shard_count);
+        m->shards = NULL;
+        m->shard_count = 0;
+    }
+    free_shared_ptr(ptr);
+    return;
+}
+
+int set_concurrent_hash_map(concurrent_hash_map const ptr, const void *const key, const void *const val)
+{
+    if (ptr == NULL)
+        return 0;
+    concurrent_hash_map_t *m = data_shared_ptr(ptr);
+    if (key == NULL || val == NULL)
+        return 0;
+    shard_t *shard = get_shard_concurrent_hash_map(m, key);
+    pthread_rwlock_wrlock(&shard->lock);
+    void *ref = NULL;
+    int result = emplace_hash_map(shard->map, key, &ref);
+    if (result == 1)
+        __atomic_store_n(&shard->count, shard->count + 1, __ATOMIC_RELAXED);
+    else if (result == 2)
+        m->container_type->t_free(ref);
+    if (result != 0)
+        m->container_type->t_cpy(ref, val);
+    pthread_rwlock_unlock(&shard->lock);
+    return result != 0;
+}
+
+int get_concurrent_hash_map(const concurrent_hash_map ptr, const void *const key, void *const val)
+{
+    if (ptr == NULL)
+        return 0;
+    concurrent_hash_map_t *m = data_shared_ptr(ptr);
+    if (key == NULL || val == NULL)
+        return 0;
+    shard_t *shard = get_shard_concurrent_hash_map(m, key);
+    pthread_rwlock_rdlock(&shard->lock);
+    int result = get_hash_map(shard->map, key, val);
+    pthread_rwlock_unlock(&shard->lock);
+    return result;
+}
+
+int delete_concurrent_hash_map(concurrent_hash_map const ptr, const void *const key, void *const val)
+{
+    if (ptr == NULL)
+        return 0;
+    concurrent_hash_map_t *m = data_shared_ptr(ptr);
+    if (key == NULL)
+        return 0;
+    shard_t *shard = get_shard_concurrent_hash_map(m, key);
+    pthread_rwlock_wrlock(&shard->lock);
+    int result = delete_hash_map(shard->map, key, val);
+    if (result != 0)
+        __atomic_store_n(&shard->count, shard->count - 1, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&shard->lock);
+    return result;
+}
+
+int has_key_concurrent_hash_map(const concurrent_hash_map ptr, const void *const key)
+{
+    if (ptr == NULL)
+        return 0;
+    concurrent_hash_map_t *m = data_shared_ptr(ptr);
+    if (key == NULL)
+        return 0;
+    shard_t *shard = get_shard_concurrent_hash_map(m, key);
+    pthread_rwlock_rdlock(&shard->lock);
+    int result = has_key_hash_map(shard->map, key);
+    pthread_rwlock_unlock(&shard->lock);
+    return result;
+}
+
+/* Sum of per-shard counts; only exact while no writer is active */
+size_t count_concurrent_hash_map(const concurrent_hash_map ptr)
+{
+    if (ptr == NULL)
+        return 0;
+    concurrent_hash_map_t *m = data_shared_ptr(ptr);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i < m->shard_count; i++)
+    {
+        count += __atomic_load_n(&m->shards[i].count, __ATOMIC_RELAXED);
+    }
+    return count;
+}
+
+/* Visits one shard at a time under its read lock */
+int for_each_concurrent_hash_map(const concurrent_hash_map ptr, hash_map_func func, void *const context)
+{
+    if (ptr == NULL || func == NULL)
+        return 0;
+    concurrent_hash_map_t *m = data_shared_ptr(ptr);
+    size_t i = 0;
+    for (; i < m->shard_count; i++)
+    {
+        pthread_rwlock_rdlock(&m->shards[i].lock);
+        for_each_hash_map(m->shards[i].map, func, context);
+        pthread_rwlock_unlock(&m->shards[i].lock);
+    }
+    return 1;
+}
+
+/* Static functions */
+static inline shard_t *get_shard_concurrent_hash_map(const concurrent_hash_map_t *const m, const void *const key)
+{
+    /* Top bits pick the shard; the shard's table probes with the low bits */
+    if (m->shard_shift == 0)
+        return m->shards;
+    return m->shards + (hash_size_t(m->keys_type->t_hash(key)) >> m->shard_shift);
+}
+
+static void free_shards_concurrent_hash_map(shard_t *const shards, const size_t count)
+{
+    size_t i = 0;
+    for (; i < count; i++)
+    {
+        pthread_rwlock_destroy(&shards[i].lock);
+        free_hash_map(shards[i].map);
+    }
+    aligned_free(shards);
+    return;
+}
@@ -1,35 +1,62 @@
-#include "hash_map.h"
+#include "hash_map_internal.h"
 #include "util_funcs.h"
+#include "string_type.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-#define HASH_MAP_MIN_SIZE 32
+#define CTRL_EMPTY ((uint8_t)0x80)
+#define CTRL_DELETED ((uint8_t)0xFE)
+#define DEFAULT_MAX_LOAD 0.875f
+#define MIGRATE_STEP 64
+#define PREFETCH_GROUPS 2
+#define LOOKUP_BATCH 16
 
-/* Struct's declarations */
-typedef enum key_status
-{
-    EMPTY,
-    DELETED,
-    USED_1,
-    USED_2
-} key_status;
+/* Static function's declarations */
+static void *t_at_no_value(const void *const src, const size_t index);
+static int t_cmp_no_value(const void *const src_1, const void *const src_2);
+static void *t_cpy_no_value(void *const dest, const void *const src);
+static void t_free_no_value(void *const src);
+static size_t t_hash_no_value(const void *const src);
+static void t_swap_no_value(void *const src_1, void *const src_2);
 
-typedef struct hash_map_t
-{
-    size_t count;
-    size_t size;
-    const type_func *keys_type;
-    const type_func *container_type;
-    key_status *status;
-    void *keys;
-    void *container;
-    key_status cur_flag;
-} hash_map_t;
+/* Stands in for a NULL container_type: no value array, every value access is a no-op */
+static const type_func no_value_type = {
+    .t_size = 0,
+    .t_at = t_at_no_value,
+    .t_cmp = t_cmp_no_value,
+    .t_cpy = t_cpy_no_value,
+    .t_move = t_cpy_no_value,
+    .t_free = t_free_no_value,
+    .t_hash = t_hash_no_value,
+    .t_swap = t_swap_no_value};
 
-/* Static function's declarations */
+static int create_table_hash_map(const hash_map_t *const m, hash_table_t *const t, const size_t size);
+static void free_table_hash_map(const hash_map_t *const m, hash_table_t *const t);
+static int resize_hash_map(hash_map_t *const m, const size_t new_size);
+static inline size_t max_count_hash_map(const hash_map_t *const m, const size_t size);
 static int expand_hash_map(hash_map_t *const m);
 static int shrink_hash_map(hash_map_t *const m);
-static size_t get_index_hash_map(const hash_map_t *const m, const void *const key);
+static int find_hash_map(const hash_map_t *const m, const void *const key, const size_t hash, int (*cmp)(const void *const, const void *const), hash_table_t **const t, size_t *const index);
+static int insert_hash_map(hash_map_t *const m, const void *const key, const size_t hash, size_t *const index);
+static void erase_hash_map(hash_map_t *const m, hash_table_t *const t, const size_t index);
+static size_t place_hash_map(hash_map_t *const m, const size_t hash);
+static size_t place_robin_hood_hash_map(hash_map_t *const m, const size_t hash);
+static void move_slot_hash_map(const hash_map_t *const m, hash_table_t *const t, const size_t dest, const size_t src);
+static size_t get_index_robin_hood_hash_map(const hash_map_t *const m, const hash_table_t *const t, const void *const key, const size_t hash, int (*cmp)(const void *const, const void *const));
+static inline size_t get_distance_hash_map(const hash_table_t *const t, const size_t index);
+static size_t get_index_hash_map(const hash_map_t *const m, const hash_table_t *const t, const void *const key, const size_t hash, int (*cmp)(const void *const, const void *const));
+static size_t get_free_index_hash_map(const uint8_t *const status, const size_t size, const size_t hash);
+static size_t get_probe_length_hash_map(const hash_map_t *const m, const hash_table_t *const t, const size_t index);
+static inline size_t hash_key_hash_map(const hash_map_t *const m, const void *const key);
+static inline uint32_t match_group(const uint8_t *const group, const uint8_t h2);
+static inline uint32_t match_empty_group(const uint8_t *const group);
+static inline uint32_t match_free_group(const uint8_t *const group);
+static inline uint32_t match_full_group(const uint8_t *const group);
+static inline void prefetch_group_hash_map(const hash_map_t *const m, const hash_table_t *const t, const size_t group);
 
 /* Main functions */
 hash_map create_hash_map(const size_t size, const type_func *const keys_type, const type_func *const container_type)
@@ -40,31 +67,24 @@ hash_map create_hash_map(const size_t size, const type_func *const keys_type, co
     size_t mul_of_2_size = size < HASH_MAP_MIN_SIZE ? HASH_MAP_MIN_SIZE : next_power_of_2(size);
     hash_map_t new_m = {
         .count = 0,
-        .size = mul_of_2_size,
+        .min_size = HASH_MAP_MIN_SIZE,
+        .seed = random_hash_seed(),
+        .max_load = DEFAULT_MAX_LOAD,
+        .incremental = 0,
+        .cache_hashes = 0,
+        .robin_hood = 0,
         .keys_type = keys_type,
-        .container_type = container_type,
-        .cur_flag = USED_1};
-    new_m.status = calloc(mul_of_2_size, sizeof(key_status));
-    if (new_m.status == NULL)
+        .container_type = values_type_hash_map(container_type),
+        .old = {0},
+        .migrated = 0,
+        .mapping = NULL,
+        .unmap = NULL,
+        .read_only = 0};
+    if (create_table_hash_map(&new_m, &new_m.table, mul_of_2_size) == 0)
     {
         free_shared_ptr(ptr);
         return NULL;
     }
-    new_m.keys = calloc(mul_of_2_size, keys_type->t_size);
-    if (new_m.keys == NULL)
-    {
-        free_shared_ptr(ptr);
-        free(new_m.status);
-        return NULL;
-    }
-    new_m.container = calloc(mul_of_2_size, container_type->t_size);
-    if (new_m.container == NULL)
-    {
-        free_shared_ptr(ptr);
-        free(new_m.status);
-        free(new_m.keys);
-        return NULL;
-    }
     memcpy(data_shared_ptr(ptr), &new_m, sizeof(hash_map_t));
     return ptr;
 }
@@ -76,33 +96,12 @@ void free_hash_map(hash_map const ptr)
     if (count_shared_ptr(ptr) == 1)
     {
         hash_map_t *m = data_shared_ptr(ptr);
-        if (m->keys != NULL)
-        {
-            size_t i = 0;
-            for (; i < m->size; i++)
-            {
-                if (m->status[i] == m->cur_flag)
-                    m->keys_type->t_free(m->keys_type->t_at(m->keys, i));
-            }
-            free(m->keys);
-        }
-        if (m->container != NULL)
-        {
-            size_t i = 0;
-            for (; i < m->size; i++)
-            {
-                if (m->status[i] == m->cur_flag)
-                    m->container_type->t_free(m->container_type->t_at(m->container, i));
-            }
-            free(m->container);
-        }
-        if (m->status != NULL)
-            free(m->status);
+        free_table_hash_map(m, &m->table);
+        free_table_hash_map(m, &m->old);
+        if (m->mapping != NULL)
+            m->unmap(m->mapping);
         m->count = 0;
-        m->size = 0;
-        m->status = NULL;
-        m->keys = NULL;
-        m->container = NULL;
+        m->migrated = 0;
     }
     free_shared_ptr(ptr);
     return;
@@ -113,47 +112,134 @@ int set_hash_map(hash_map const ptr, const void *const key, const void *const va
     if (ptr == NULL)
         return 0;
     hash_map_t *m = data_shared_ptr(ptr);
-    if (key == NULL || val == NULL || m->count == SIZE_MAX)
+    if (key == NULL || val == NULL || m->count == SIZE_MAX || m->read_only)
         return 0;
-    size_t index = m->keys_type->t_hash(key) % m->size;
-    size_t i = index;
-    size_t offset = 1;
-    for (;;)
+    migrate_hash_map(m, MIGRATE_STEP);
+    hash_table_t *t = NULL;
+    size_t index = 0;
+    size_t hash = hash_key_hash_map(m, key);
+    if (find_hash_map(m, key, hash, m->keys_type->t_cmp, &t, &index))
+    {
+        m->container_type->t_free(m->container_type->t_at(t->container, index));
+        m->container_type->t_cpy(m->container_type->t_at(t->container, index), val);
+        return 1;
+    }
+    if (insert_hash_map(m, key, hash, &index) == 0)
+        return 0;
+    m->container_type->t_cpy(m->container_type->t_at(m->table.container, index), val);
+    return 1;
+}
+
+/* Returns 1 if key was inserted, 2 if it was already present; *ref (optional) points at its value */
+int emplace_hash_map(hash_map const ptr, const void *const key, void **const ref)
+{
+    if (ptr == NULL)
+        return 0;
+    hash_map_t *m = data_shared_ptr(ptr);
+    if (key == NULL || m->count == SIZE_MAX || m->read_only)
+        return 0;
+    migrate_hash_map(m, MIGRATE_STEP);
+    hash_table_t *t = NULL;
+    size_t index = 0;
+    size_t hash = hash_key_hash_map(m, key);
+    if (find_hash_map(m, key, hash, m->keys_type->t_cmp, &t, &index))
+    {
+        if (ref != NULL)
+            *ref = m->container_type->t_at(t->container, index);
+        return 2;
+    }
+    if (insert_hash_map(m, key, hash, &index) == 0)
+        return 0;
+    if (ref != NULL)
+        *ref = m->container_type->t_at(m->table.container, index);
+    return 1;
+}
+
+int get_hash_map(const hash_map ptr, const void *const key, void *const val)
+{
+    if (ptr == NULL)
+        return 0;
+    hash_map_t *m = data_shared_ptr(ptr);
+    if (key == NULL || val == NULL || m->count == 0)
+        return 0;
+    hash_table_t *t = NULL;
+    size_t index = 0;
+    size_t hash = hash_key_hash_map(m, key);
+    if (find_hash_map(m, key, hash, m->keys_type->t_cmp, &t, &index) == 0)
+        return 0;
+    m->container_type->t_cpy(val, m->container_type->t_at(t->container, index));
+    return 1;
+}
+
+/* Looks up keys in batches: hash all, prefetch home groups, then probe */
+int get_many_hash_map(const hash_map ptr, const void *const keys, const size_t n, void *const vals, int *const found)
+{
+    if (ptr == NULL)
+        return 0;
+    hash_map_t *m = data_shared_ptr(ptr);
+    if (keys == NULL || vals == NULL)
+        return 0;
+    const size_t groups_mask = m->table.size / GROUP_SIZE - 1;
+    size_t hashes[LOOKUP_BATCH];
+    size_t batch = 0;
+    for (; batch < n; batch += LOOKUP_BATCH)
     {
-        key_status *status = m->status + i;
-        if (*status == m->cur_flag && m->keys_type->t_cmp(m->keys_type->t_at(m->keys, i), key) == 0)
+        size_t batch_size = n - batch < LOOKUP_BATCH ? n - batch : LOOKUP_BATCH;
+        size_t i = 0;
+        for (; i < batch_size; i++)
         {
-            m->container_type->t_free(m->container_type->t_at(m->container, i));
-            m->container_type->t_cpy(m->container_type->t_at(m->container, i), val);
-            return 1;
+            hashes[i] = hash_key_hash_map(m, m->keys_type->t_at(keys, batch + i));
+            size_t slot = m->robin_hood ? (hashes[i] >> 7) & (m->table.size - 1) : ((hashes[i] >> 7) & groups_mask) * GROUP_SIZE;
+            __builtin_prefetch(m->table.status + slot);
+            __builtin_prefetch(m->keys_type->t_at(m->table.keys, slot));
         }
-        else
+        for (i = 0; i < batch_size; i++)
         {
-            if (*status != m->cur_flag)
-            {
-                *status = m->cur_flag;
-                m->keys_type->t_cpy(m->keys_type->t_at(m->keys, i), key);
-                m->container_type->t_cpy(m->container_type->t_at(m->container, i), val);
-                return expand_hash_map(m);
-            }
-            i = (i + offset++) % m->size;
-            if (i == index)
-                return 0;
+            hash_table_t *t = NULL;
+            size_t index = 0;
+            int has = m->count != 0 && find_hash_map(m, m->keys_type->t_at(keys, batch + i), hashes[i], m->keys_type->t_cmp, &t, &index);
+            if (has)
+                m->container_type->t_cpy(m->container_type->t_at(vals, batch + i), m->container_type->t_at(t->container, index));
+            if (found != NULL)
+                found[batch + i] = has;
         }
     }
+    return 1;
 }
 
-int get_hash_map(const hash_map ptr, const void *const key, void *const val)
+/* *ref stays valid until the next set, emplace or delete; read-only mapped maps get NULL and 0 */
+int get_ref_hash_map(const hash_map ptr, const void *const key, void **const ref)
 {
     if (ptr == NULL)
         return 0;
     hash_map_t *m = data_shared_ptr(ptr);
-    if (key == NULL || val == NULL || m->count == 0)
+    if (ref != NULL)
+        *ref = NULL;
+    if (key == NULL || ref == NULL || m->count == 0 || m->read_only)
         return 0;
-    size_t index = get_index_hash_map(m, key);
-    if (index == m->size)
+    hash_table_t *t = NULL;
+    size_t index = 0;
+    size_t hash = hash_key_hash_map(m, key);
+    if (find_hash_map(m, key, hash, m->keys_type->t_cmp, &t, &index) == 0)
         return 0;
-    m->container_type->t_cpy(val, m->container_type->t_at(m->container, index));
+    *ref = m->container_type->t_at(t->container, index);
+    return 1;
+}
+
+/* Looks up a f_string_t keyed map with borrowed characters, no string_t needed */
+int get_str_hash_map(const hash_map ptr, const char *const key, const size_t len, void *const val)
+{
+    if (ptr == NULL)
+        return 0;
+    hash_map_t *m = data_shared_ptr(ptr);
+    if (key == NULL || val == NULL || m->count == 0 || m->keys_type != f_string_t)
+        return 0;
+    hash_table_t *t = NULL;
+    size_t index = 0;
+    string_view_t view = {.str = key, .len = len};
+    if (find_hash_map(m, &view, hash_bytes(key, len, m->seed), cmp_string_view, &t, &index) == 0)
+        return 0;
+    m->container_type->t_cpy(val, m->container_type->t_at(t->container, index));
     return 1;
 }
 
@@ -162,16 +248,19 @@ int delete_hash_map(hash_map const ptr, const void *const key, void *const val)
     if (ptr == NULL)
         return 0;
     hash_map_t *m = data_shared_ptr(ptr);
-    if (key == NULL || m->count == 0)
+    if (key == NULL || m->count == 0 || m->read_only)
         return 0;
-    size_t index = get_index_hash_map(m, key);
-    if (index == m->size)
+    migrate_hash_map(m, MIGRATE_STEP);
+    hash_table_t *t = NULL;
+    size_t index = 0;
+    size_t hash = hash_key_hash_map(m, key);
+    if (find_hash_map(m, key, hash, m->keys_type->t_cmp, &t, &index) == 0)
         return 0;
     if (val != NULL)
-        m->container_type->t_cpy(val, m->container_type->t_at(m->container, index));
-    *(m->status + index) = DELETED;
-    m->keys_type->t_free(m->keys_type->t_at(m->keys, index));
-    m->container_type->t_free(m->container_type->t_at(m->container, index));
+        m->container_type->t_cpy(val, m->container_type->t_at(t->container, index));
+    m->keys_type->t_free(m->keys_type->t_at(t->keys, index));
+    m->container_type->t_free(m->container_type->t_at(t->container, index));
+    erase_hash_map(m, t, index);
     return shrink_hash_map(m);
 }
 
@@ -182,146 +271,686 @@ int has_key_hash_map(const hash_map ptr, const void *const key)
     hash_map_t *m = data_shared_ptr(ptr);
     if (key == NULL)
         return 0;
-    else
-        return get_index_hash_map(m, key) != m->size;
+    hash_table_t *t = NULL;
+    size_t index = 0;
+    return find_hash_map(m, key, hash_key_hash_map(m, key), m->keys_type->t_cmp, &t, &index);
 }
 
-/* Static functions */
-static int expand_hash_map(hash_map_t *const m)
+size_t count_hash_map(const hash_map ptr)
+{
+    if (ptr == NULL)
+        return 0;
+    hash_map_t *m = data_shared_ptr(ptr);
+    return m->count;
+}
+
+const type_func *keys_type_hash_map(const hash_map ptr)
 {
-    if (++m->count < m->size)
+    if (ptr == NULL)
+        return NULL;
+    hash_map_t *m = data_shared_ptr(ptr);
+    return m->keys_type;
+}
+
+int set_max_load_factor_hash_map(hash_map const ptr, const float max_load_factor)
+{
+    if (ptr == NULL)
+        return 0;
+    hash_map_t *m = data_shared_ptr(ptr);
+    if (max_load_factor < MIN_MAX_LOAD || max_load_factor > MAX_MAX_LOAD || m->read_only)
+        return 0;
+    m->max_load = max_load_factor;
+    size_t new_size = m->table.size;
+    while (max_count_hash_map(m, new_size) < m->count)
+        new_size <<= 1;
+    return resize_hash_map(m, new_size);
+}
+
+int reserve_hash_map(hash_map const ptr, const size_t count)
+{
+    if (ptr == NULL)
+        return 0;
+    hash_map_t *m = data_shared_ptr(ptr);
+    if (m->read_only)
+        return 0;
+    size_t new_size = HASH_MAP_MIN_SIZE;
+    while (max_count_hash_map(m, new_size) < count)
+    {
+        if (new_size > SIZE_MAX / 2)
+            return 0;
+        new_size <<= 1;
+    }
+    m->min_size = new_size;
+    if (m->old.status == NULL && new_size <= m->table.size && m->table.growth_left + m->count >= count)
         return 1;
-    size_t mul_of_2_size = next_power_of_2(m->size << 1);
-    key_status *new_status = realloc(m->status, mul_of_2_size * sizeof(key_status));
-    if (new_status == NULL)
+    return resize_hash_map(m, new_size > m->table.size ? new_size : m->table.size);
+}
+
+int set_incremental_hash_map(hash_map const ptr, const int incremental)
+{
+    if (ptr == NULL)
         return 0;
-    void *new_keys = realloc(m->keys, mul_of_2_size * m->keys_type->t_size);
-    if (new_keys == NULL)
+    hash_map_t *m = data_shared_ptr(ptr);
+    m->incremental = incremental != 0;
+    if (m->incremental == 0)
+        migrate_hash_map(m, m->old.size);
+    return 1;
+}
+
+int set_cache_hashes_hash_map(hash_map const ptr, const int cache_hashes)
+{
+    if (ptr == NULL)
+        return 0;
+    hash_map_t *m = data_shared_ptr(ptr);
+    if (m->cache_hashes == (cache_hashes != 0))
+        return 1;
+    if ((m->robin_hood && cache_hashes == 0) || m->read_only)
+        return 0;
+    m->cache_hashes = cache_hashes != 0;
+    /* Rebuild so the table gains or drops its hash array */
+    if (resize_hash_map(m, m->table.size) == 0)
     {
-        free(new_status);
+        m->cache_hashes = !m->cache_hashes;
         return 0;
     }
-    void *new_container = realloc(m->container, mul_of_2_size * m->container_type->t_size);
-    if (new_container == NULL)
+    migrate_hash_map(m, m->old.size);
+    return 1;
+}
+
+int next_hash_map(const hash_map ptr, hash_map_iter_t *const it, void **const key, void **const val)
+{
+    if (ptr == NULL || it == NULL)
+        return 0;
+    hash_map_t *m = data_shared_ptr(ptr);
+    for (; it->table < 2; it->table++, it->index = 0)
     {
-        free(new_status);
-        free(new_keys);
+        const hash_table_t *t = it->table == 0 ? &m->table : &m->old;
+        while (it->index < t->size)
+        {
+            size_t group = it->index & ~(size_t)(GROUP_SIZE - 1);
+            uint32_t full = match_full_group(t->status + group) >> (it->index - group);
+            if (full == 0)
+            {
+                it->index = group + GROUP_SIZE;
+                continue;
+            }
+            size_t i = it->index + __builtin_ctz(full);
+            it->index = i + 1;
+            if (key != NULL)
+                *key = m->keys_type->t_at(t->keys, i);
+            if (val != NULL)
+                *val = m->container_type->t_at(t->container, i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int for_each_hash_map(const hash_map ptr, hash_map_func func, void *const context)
+{
+    if (ptr == NULL || func == NULL)
         return 0;
+    hash_map_t *m = data_shared_ptr(ptr);
+    const hash_table_t *tables[2] = {&m->table, &m->old};
+    int k = 0;
+    for (; k < 2; k++)
+    {
+        const hash_table_t *t = tables[k];
+        size_t groups = t->size / GROUP_SIZE;
+        size_t group = 0;
+        for (; group < groups; group++)
+        {
+            if (group + PREFETCH_GROUPS < groups)
+                prefetch_group_hash_map(m, t, group + PREFETCH_GROUPS);
+            uint32_t full = match_full_group(t->status + group * GROUP_SIZE);
+            while (full != 0)
+            {
+                size_t i = group * GROUP_SIZE + __builtin_ctz(full);
+                func(m->keys_type->t_at(t->keys, i), m->container_type->t_at(t->container, i), context);
+                full &= full - 1;
+            }
+        }
     }
-    size_t i = 0;
-    key_status new_flag = m->cur_flag == USED_1 ? USED_2 : USED_1;
-    memset(new_status + m->size, 0, (mul_of_2_size - m->size) * sizeof(key_status));
-    memset(m->keys_type->t_at(new_keys, m->size), 0, (mul_of_2_size - m->size) * m->keys_type->t_size);
-    memset(m->container_type->t_at(new_container, m->size), 0, (mul_of_2_size - m->size) * m->container_type->t_size);
-    for (; i < m->size; i++)
+    return 1;
+}
+
+int export_hash_map(const hash_map ptr, vector const keys, vector const values)
+{
+    if (ptr == NULL)
+        return 0;
+    hash_map_t *m = data_shared_ptr(ptr);
+    const hash_table_t *tables[2] = {&m->table, &m->old};
+    int k = 0;
+    for (; k < 2; k++)
     {
-        if (new_status[i] != m->cur_flag)
-            continue;
-        key_status *cur_status = new_status + i;
-        void *key = m->keys_type->t_at(new_keys, i);
-        void *val = m->container_type->t_at(new_container, i);
-        size_t index = m->keys_type->t_hash(key) % mul_of_2_size;
-        size_t offset = 1;
-        for (;;)
+        const hash_table_t *t = tables[k];
+        size_t groups = t->size / GROUP_SIZE;
+        size_t group = 0;
+        for (; group < groups; group++)
         {
-            key_status *old_status = new_status + index;
-            if (*old_status != new_flag)
+            if (group + PREFETCH_GROUPS < groups)
+                prefetch_group_hash_map(m, t, group + PREFETCH_GROUPS);
+            uint32_t full = match_full_group(t->status + group * GROUP_SIZE);
+            while (full != 0)
             {
-                if (*old_status == m->cur_flag)
-                    i--;
-                m->keys_type->t_swap(m->keys_type->t_at(new_keys, index), key);
-                m->container_type->t_swap(m->container_type->t_at(new_container, index), val);
-                *cur_status = (*old_status == DELETED) ? EMPTY : *old_status;
-                *old_status = new_flag;
-                break;
+                size_t i = group * GROUP_SIZE + __builtin_ctz(full);
+                if (keys != NULL && append_vector(keys, m->keys_type->t_at(t->keys, i)) == 0)
+                    return 0;
+                if (values != NULL && m->container_type->t_size != 0 && append_vector(values, m->container_type->t_at(t->container, i)) == 0)
+                    return 0;
+                full &= full - 1;
             }
-            index = (index + offset++) % mul_of_2_size;
         }
     }
-    m->status = new_status;
-    m->keys = new_keys;
-    m->container = new_container;
-    m->size = mul_of_2_size;
-    m->cur_flag = new_flag;
     return 1;
 }
 
-static int shrink_hash_map(hash_map_t *const m)
+int has_key_str_hash_map(const hash_map ptr, const char *const key, const size_t len)
 {
-    if (--m->count > m->size >> 3)
-        return 1;
-    size_t mul_of_2_size = next_power_of_2(m->size >> 1);
-    if (mul_of_2_size <= HASH_MAP_MIN_SIZE)
+    if (ptr == NULL)
+        return 0;
+    hash_map_t *m = data_shared_ptr(ptr);
+    if (key == NULL || m->keys_type != f_string_t)
+        return 0;
+    hash_table_t *t = NULL;
+    size_t index = 0;
+    string_view_t view = {.str = key, .len = len};
+    return find_hash_map(m, &view, hash_bytes(key, len, m->seed), cmp_string_view, &t, &index);
+}
+
+/* Robin Hood probing keeps its distances in the cached hashes, so it turns caching on */
+int set_robin_hood_hash_map(hash_map const ptr, const int robin_hood)
+{
+    if (ptr == NULL)
+        return 0;
+    hash_map_t *m = data_shared_ptr(ptr);
+    if (m->robin_hood == (robin_hood != 0))
         return 1;
-    size_t i = 0;
-    key_status new_flag = m->cur_flag == USED_1 ? USED_2 : USED_1;
-    for (; i < m->size; i++)
+    if (m->read_only)
+        return 0;
+    migrate_hash_map(m, m->old.size);
+    int cache_hashes = m->cache_hashes;
+    m->robin_hood = robin_hood != 0;
+    m->cache_hashes = 1;
+    /* Rebuild under the new policy, draining the old table right away */
+    if (resize_hash_map(m, m->table.size) == 0)
     {
-        if (m->status[i] != m->cur_flag)
-            continue;
-        key_status *cur_status = m->status + i;
-        void *key = m->keys_type->t_at(m->keys, i);
-        void *val = m->container_type->t_at(m->container, i);
-        size_t index = m->keys_type->t_hash(key) % mul_of_2_size;
-        size_t offset = 1;
-        for (;;)
+        m->robin_hood = !m->robin_hood;
+        m->cache_hashes = cache_hashes;
+        return 0;
+    }
+    migrate_hash_map(m, m->old.size);
+    return 1;
+}
+
+hash_map_stats_t stats_hash_map(const hash_map ptr)
+{
+    hash_map_stats_t stats = {0};
+    if (ptr == NULL)
+        return stats;
+    hash_map_t *m = data_shared_ptr(ptr);
+    stats.count = m->count;
+    stats.size = m->table.size + m->old.size;
+    stats.load_factor = (float)m->count / m->table.size;
+    stats.max_load_factor = m->max_load;
+    size_t probe_sum = 0;
+    const hash_table_t *tables[2] = {&m->table, &m->old};
+    int k = 0;
+    for (; k < 2; k++)
+    {
+        const hash_table_t *t = tables[k];
+        size_t i = 0;
+        for (; i < t->size; i++)
         {
-            key_status *old_status = m->status + index;
-            if (*old_status != new_flag)
+            if (t->status[i] == CTRL_DELETED)
             {
-                if (*old_status == m->cur_flag)
-                    i--;
-                m->keys_type->t_swap(m->keys_type->t_at(m->keys, index), key);
-                m->container_type->t_swap(m->container_type->t_at(m->container, index), val);
-                *cur_status = (*old_status == DELETED) ? EMPTY : *old_status;
-                *old_status = new_flag;
-                break;
+                stats.tombstones++;
+            }
+            else if ((t->status[i] & CTRL_EMPTY) == 0)
+            {
+                size_t probe = get_probe_length_hash_map(m, t, i);
+                probe_sum += probe;
+                if (probe > stats.max_probe)
+                    stats.max_probe = probe;
             }
-            index = (index + offset++) % mul_of_2_size;
         }
     }
-    key_status *new_status = realloc(m->status, mul_of_2_size * sizeof(key_status));
-    if (new_status == NULL)
+    stats.average_probe = m->count != 0 ? (float)probe_sum / m->count : 0.0f;
+    return stats;
+}
+
+/* Shared with hash_map_io.c */
+const type_func *values_type_hash_map(const type_func *const container_type)
+{
+    return container_type != NULL ? container_type : &no_value_type;
+}
+
+/* Static functions */
+static int create_table_hash_map(const hash_map_t *const m, hash_table_t *const t, const size_t size)
+{
+    uint8_t *status = malloc(size * sizeof(uint8_t));
+    if (status == NULL)
         return 0;
-    void *new_keys = realloc(m->keys, mul_of_2_size * m->keys_type->t_size);
-    if (new_keys == NULL)
+    void *keys = calloc(size, m->keys_type->t_size);
+    if (keys == NULL)
     {
-        free(new_status);
+        free(status);
         return 0;
     }
-    void *new_container = realloc(m->container, mul_of_2_size * m->container_type->t_size);
-    if (new_container == NULL)
+    void *container = NULL;
+    if (m->container_type->t_size != 0)
+    {
+        container = calloc(size, m->container_type->t_size);
+        if (container == NULL)
+        {
+            free(status);
+            free(keys);
+            return 0;
+        }
+    }
+    size_t *hashes = NULL;
+    if (m->cache_hashes)
+    {
+        hashes = malloc(size * sizeof(size_t));
+        if (hashes == NULL)
+        {
+            free(status);
+            free(keys);
+            free(container);
+            return 0;
+        }
+    }
+    memset(status, CTRL_EMPTY, size * sizeof(uint8_t));
+    t->size = size;
+    t->growth_left = max_count_hash_map(m, size);
+    t->status = status;
+    t->hashes = hashes;
+    t->keys = keys;
+    t->container = container;
+    t->mapped = 0;
+    return 1;
+}
+
+static void free_table_hash_map(const hash_map_t *const m, hash_table_t *const t)
+{
+    if (t->status == NULL)
+        return;
+    /* Mapped entries are trivially copyable and owned by the mapping */
+    if (t->mapped)
+    {
+        *t = (hash_table_t){0};
+        return;
+    }
+    size_t i = 0;
+    for (; i < t->size; i++)
+    {
+        if ((t->status[i] & CTRL_EMPTY) != 0)
+            continue;
+        m->keys_type->t_free(m->keys_type->t_at(t->keys, i));
+        m->container_type->t_free(m->container_type->t_at(t->container, i));
+    }
+    free(t->status);
+    free(t->hashes);
+    free(t->keys);
+    free(t->container);
+    *t = (hash_table_t){0};
+    return;
+}
+
+void migrate_hash_map(hash_map_t *const m, size_t steps)
+{
+    if (m->old.status == NULL)
+        return;
+    for (; steps != 0 && m->migrated < m->old.size; steps--, m->migrated++)
+    {
+        if ((m->old.status[m->migrated] & CTRL_EMPTY) != 0)
+            continue;
+        void *key = m->keys_type->t_at(m->old.keys, m->migrated);
+        size_t hash = m->old.hashes != NULL ? m->old.hashes[m->migrated] : hash_key_hash_map(m, key);
+        size_t index = place_hash_map(m, hash);
+        m->keys_type->t_move(m->keys_type->t_at(m->table.keys, index), key);
+        m->container_type->t_move(m->container_type->t_at(m->table.container, index), m->container_type->t_at(m->old.container, m->migrated));
+        m->old.status[m->migrated] = CTRL_DELETED;
+    }
+    if (m->migrated == m->old.size)
+    {
+        if (m->old.mapped == 0)
+        {
+            free(m->old.status);
+            free(m->old.hashes);
+            free(m->old.keys);
+            free(m->old.container);
+        }
+        m->old = (hash_table_t){0};
+        m->migrated = 0;
+    }
+    return;
+}
+
+static int resize_hash_map(hash_map_t *const m, const size_t new_size)
+{
+    migrate_hash_map(m, m->old.size);
+    hash_table_t table;
+    if (create_table_hash_map(m, &table, new_size) == 0)
+        return 0;
+    m->old = m->table;
+    m->table = table;
+    m->migrated = 0;
+    if (m->incremental == 0)
+        migrate_hash_map(m, m->old.size);
+    return 1;
+}
+
+static inline size_t max_count_hash_map(const hash_map_t *const m, const size_t size)
+{
+    return (size_t)(size * m->max_load);
+}
+
+static int expand_hash_map(hash_map_t *const m)
+{
+    /* Mostly tombstones: rehash in place instead of doubling */
+    if (m->count * 2 < max_count_hash_map(m, m->table.size))
+        return resize_hash_map(m, m->table.size);
+    return resize_hash_map(m, m->table.size << 1);
+}
+
+static int shrink_hash_map(hash_map_t *const m)
+{
+    if (--m->count > m->table.size >> 3)
+        return 1;
+    size_t mul_of_2_size = m->table.size >> 1;
+    if (mul_of_2_size < m->min_size)
+        return 1;
+    return resize_hash_map(m, mul_of_2_size);
+}
+
+static int find_hash_map(const hash_map_t *const m, const void *const key, const size_t hash, int (*cmp)(const void *const, const void *const), hash_table_t **const t, size_t *const index)
+{
+    *index = get_index_hash_map(m, &m->table, key, hash, cmp);
+    if (*index != m->table.size)
     {
-        free(new_status);
-        free(new_keys);
+        *t = (hash_table_t *)&m->table;
+        return 1;
+    }
+    if (m->old.status == NULL)
         return 0;
+    *index = get_index_hash_map(m, &m->old, key, hash, cmp);
+    if (*index != m->old.size)
+    {
+        *t = (hash_table_t *)&m->old;
+        return 1;
     }
-    m->status = new_status;
-    m->keys = new_keys;
-    m->container = new_container;
-    m->size = mul_of_2_size;
-    m->cur_flag = new_flag;
+    return 0;
+}
+
+static int insert_hash_map(hash_map_t *const m, const void *const key, const size_t hash, size_t *const index)
+{
+    if (m->table.growth_left == 0 && expand_hash_map(m) == 0)
+        return 0;
+    *index = place_hash_map(m, hash);
+    /* The slot may still hold a stale handle that t_cpy would mistake for its own */
+    memset(m->keys_type->t_at(m->table.keys, *index), 0, m->keys_type->t_size);
+    if (m->container_type->t_size != 0)
+        memset(m->container_type->t_at(m->table.container, *index), 0, m->container_type->t_size);
+    m->keys_type->t_cpy(m->keys_type->t_at(m->table.keys, *index), key);
+    m->count++;
     return 1;
 }
 
-static size_t get_index_hash_map(const hash_map_t *const m, const void *const key)
+static void erase_hash_map(hash_map_t *const m, hash_table_t *const t, const size_t index)
 {
-    size_t index = m->keys_type->t_hash(key) % m->size;
-    size_t i = index;
-    size_t offset = 1;
+    if (m->robin_hood && t == &m->table)
+    {
+        /* Backward shift: pull the rest of the run one slot closer to home */
+        const size_t mask = t->size - 1;
+        size_t hole = index;
+        size_t next = (hole + 1) & mask;
+        while (t->status[next] != CTRL_EMPTY && get_distance_hash_map(t, next) != 0)
+        {
+            move_slot_hash_map(m, t, hole, next);
+            hole = next;
+            next = (next + 1) & mask;
+        }
+        t->status[hole] = CTRL_EMPTY;
+        t->growth_left++;
+        return;
+    }
+    /* A draining table is never probed for inserts, so it can simply take a tombstone */
+    if (m->robin_hood)
+    {
+        t->status[index] = CTRL_DELETED;
+        return;
+    }
+    /* A group with an empty slot already stops every probe, so the slot can become empty again */
+    if (match_empty_group(t->status + (index & ~(size_t)(GROUP_SIZE - 1))) != 0)
+    {
+        t->status[index] = CTRL_EMPTY;
+        t->growth_left++;
+    }
+    else
+    {
+        t->status[index] = CTRL_DELETED;
+    }
+    return;
+}
+
+static size_t get_index_hash_map(const hash_map_t *const m, const hash_table_t *const t, const void *const key, const size_t hash, int (*cmp)(const void *const, const void *const))
+{
+    if (m->robin_hood)
+        return get_index_robin_hood_hash_map(m, t, key, hash, cmp);
+    const size_t groups_mask = t->size / GROUP_SIZE - 1;
+    size_t group = (hash >> 7) & groups_mask;
+    size_t step = 0;
     for (;;)
     {
-        key_status *status = m->status + i;
-        if (*status == m->cur_flag && m->keys_type->t_cmp(m->keys_type->t_at(m->keys, i), key) == 0)
-            return i;
-        else if (*status == EMPTY)
-            return m->size;
-        i = (i + offset++) % m->size;
-        if (i == index)
-            return m->size;
+        const uint8_t *ctrl = t->status + group * GROUP_SIZE;
+        uint32_t matches = match_group(ctrl, hash & 0x7F);
+        while (matches != 0)
+        {
+            size_t i = group * GROUP_SIZE + __builtin_ctz(matches);
+            if ((t->hashes == NULL || t->hashes[i] == hash) &&
+                cmp(m->keys_type->t_at(t->keys, i), key) == 0)
+                return i;
+            matches &= matches - 1;
+        }
+        if (match_empty_group(ctrl) != 0 || step == groups_mask)
+            return t->size;
+        group = (group + ++step) & groups_mask;
     }
 }
 
+static size_t place_hash_map(hash_map_t *const m, const size_t hash)
+{
+    if (m->robin_hood)
+        return place_robin_hood_hash_map(m, hash);
+    size_t index = get_free_index_hash_map(m->table.status, m->table.size, hash);
+    if (m->table.status[index] == CTRL_EMPTY)
+        m->table.growth_left--;
+    m->table.status[index] = hash & 0x7F;
+    if (m->table.hashes != NULL)
+        m->table.hashes[index] = hash;
+    return index;
+}
+
+/* Takes the first slot whose entry is closer to home than we are and shifts that run right by one */
+static size_t place_robin_hood_hash_map(hash_map_t *const m, const size_t hash)
+{
+    hash_table_t *t = &m->table;
+    const size_t mask = t->size - 1;
+    size_t index = (hash >> 7) & mask;
+    size_t distance = 0;
+    while (t->status[index] != CTRL_EMPTY && get_distance_hash_map(t, index) >= distance)
+    {
+        index = (index + 1) & mask;
+        distance++;
+    }
+    size_t empty = index;
+    while (t->status[empty] != CTRL_EMPTY)
+        empty = (empty + 1) & mask;
+    for (; empty != index; empty = (empty - 1) & mask)
+        move_slot_hash_map(m, t, empty, (empty - 1) & mask);
+    t->growth_left--;
+    t->status[index] = hash & 0x7F;
+    t->hashes[index] = hash;
+    return index;
+}
+
+static void move_slot_hash_map(const hash_map_t *const m, hash_table_t *const t, const size_t dest, const size_t src)
+{
+    t->status[dest] = t->status[src];
+    t->hashes[dest] = t->hashes[src];
+    m->keys_type->t_move(m->keys_type->t_at(t->keys, dest), m->keys_type->t_at(t->keys, src));
+    m->container_type->t_move(m->container_type->t_at(t->container, dest), m->container_type->t_at(t->container, src));
+    return;
+}
+
+static size_t get_index_robin_hood_hash_map(const hash_map_t *const m, const hash_table_t *const t, const void *const key, const size_t hash, int (*cmp)(const void *const, const void *const))
+{
+    const size_t mask = t->size - 1;
+    const uint8_t h2 = hash & 0x7F;
+    size_t index = (hash >> 7) & mask;
+    size_t distance = 0;
+    for (; distance < t->size; distance++, index = (index + 1) & mask)
+    {
+        uint8_t ctrl = t->status[index];
+        if (ctrl == CTRL_EMPTY)
+            break;
+        if (ctrl == CTRL_DELETED)
+            continue;
+        /* Entries are sorted by home slot, so a closer-to-home entry ends the search */
+        if (get_distance_hash_map(t, index) < distance)
+            break;
+        if (ctrl == h2 && t->hashes[index] == hash && cmp(m->keys_type->t_at(t->keys, index), key) == 0)
+            return index;
+    }
+    return t->size;
+}
+
+static inline size_t get_distance_hash_map(const hash_table_t *const t, const size_t index)
+{
+    return (index - (t->hashes[index] >> 7)) & (t->size - 1);
+}
+
+static size_t get_free_index_hash_map(const uint8_t *const status, const size_t size, const size_t hash)
+{
+    const size_t groups_mask = size / GROUP_SIZE - 1;
+    size_t group = (hash >> 7) & groups_mask;
+    size_t step = 0;
+    for (;;)
+    {
+        uint32_t free_slots = match_free_group(status + group * GROUP_SIZE);
+        if (free_slots != 0)
+            return group * GROUP_SIZE + __builtin_ctz(free_slots);
+        group = (group + ++step) & groups_mask;
+    }
+}
+
+static size_t get_probe_length_hash_map(const hash_map_t *const m, const hash_table_t *const t, const size_t index)
+{
+    if (m->robin_hood)
+        return get_distance_hash_map(t, index) + 1;
+    const size_t groups_mask = t->size / GROUP_SIZE - 1;
+    size_t hash = t->hashes != NULL ? t->hashes[index] : hash_key_hash_map(m, m->keys_type->t_at(t->keys, index));
+    size_t group = (hash >> 7) & groups_mask;
+    size_t step = 0;
+    while (group != index / GROUP_SIZE)
+        group = (group + ++step) & groups_mask;
+    return step + 1;
+}
+
+static inline size_t hash_key_hash_map(const hash_map_t *const m, const void *const key)
+{
+    /* Keyed hashing stops colliding keys from colliding in every map; the xor fallback only reshuffles slots */
+    if (m->keys_type->t_hash_seed != NULL)
+        return m->keys_type->t_hash_seed(key, m->seed);
+    return hash_size_t(m->keys_type->t_hash(key) ^ m->seed);
+}
+
+static inline uint32_t match_group(const uint8_t *const group, const uint8_t h2)
+{
+#ifdef __SSE2__
+    const __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)h2)));
+#else
+    uint32_t mask = 0;
+    int i = 0;
+    for (; i < GROUP_SIZE; i++)
+        mask |= (uint32_t)(group[i] == h2) << i;
+    return mask;
+#endif
+}
+
+static inline uint32_t match_empty_group(const uint8_t *const group)
+{
+    return match_group(group, CTRL_EMPTY);
+}
+
+static inline uint32_t match_free_group(const uint8_t *const group)
+{
+#ifdef __SSE2__
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+    uint32_t mask = 0;
+    int i = 0;
+    for (; i < GROUP_SIZE; i++)
+        mask |= (uint32_t)(group[i] >> 7) << i;
+    return mask;
+#endif
+}
+
+static inline uint32_t match_full_group(const uint8_t *const group)
+{
+    return ~match_free_group(group) & ((1u << GROUP_SIZE) - 1);
+}
+
+static inline void prefetch_group_hash_map(const hash_map_t *const m, const hash_table_t *const t, const size_t group)
+{
+    size_t i = group * GROUP_SIZE;
+    __builtin_prefetch(t->status + i);
+    __builtin_prefetch(m->keys_type->t_at(t->keys, i));
+    __builtin_prefetch(m->container_type->t_at(t->container, i));
+    return;
+}
+
+static void *t_at_no_value(const void *const src, const size_t index)
+{
+    (void)src;
+    (void)index;
+    return NULL;
+}
+
+static int t_cmp_no_value(const void *const src_1, const void *const src_2)
+{
+    (void)src_1;
+    (void)src_2;
+    return 0;
+}
+
+static void *t_cpy_no_value(void *const dest, const void *const src)
+{
+    (void)src;
+    return dest;
+}
+
+static void t_free_no_value(void *const src)
+{
+    (void)src;
+    return;
+}
+
+static size_t t_hash_no_value(const void *const src)
+{
+    (void)src;
+    return 0;
+}
+
+static void t_swap_no_value(void *const src_1, void *const src_2)
+{
+    (void)src_1;
+    (void)src_2;
+    return;
+}
+
 /* Type functionality */
 void *t_at_hash_map(const void *const src, const size_t index)
 {
@@ -332,7 +961,7 @@ int t_cmp_hash_map(const void *const src_1, const void *const src_2)
 {
     hash_map_t *a = data_shared_ptr(*(hash_map *)src_1);
     hash_map_t *b = data_shared_ptr(*(hash_map *)src_2);
-    return a->size > b->size;
+    return a->table.size > b->table.size;
 }
 
 void *t_cpy_hash_map(void *const dest, const void *const src)
@@ -360,13 +989,14 @@ size_t t_hash_hash_map(const void *const src)
     hash_map_t *m = data_shared_ptr(*(hash_map *)src);
     size_t h = 0;
     h = hash_size_t(m->count);
-    h = hash_size_t(m->size) ^ (h << 6) ^ (h >> 2);
+    h = hash_size_t(m->table.size) ^ (h << 6) ^ (h >> 2);
     h = hash_size_t((size_t)m->keys_type) ^ (h << 6) ^ (h >> 2);
     h = hash_size_t((size_t)m->container_type) ^ (h << 6) ^ (h >> 2);
-    h = hash_size_t((size_t)m->status) ^ (h << 6) ^ (h >> 2);
-    h = hash_size_t((size_t)m->keys) ^ (h << 6) ^ (h >> 2);
-    h = hash_size_t((size_t)m->container) ^ (h << 6) ^ (h >> 2);
-    h = hash_size_t((size_t)m->cur_flag) ^ (h << 6) ^ (h >> 2);
+    h = hash_size_t((size_t)m->table.status) ^ (h << 6) ^ (h >> 2);
+    h = hash_size_t((size_t)m->table.keys) ^ (h << 6) ^ (h >> 2);
+    h = hash_size_t((size_t)m->table.container) ^ (h << 6) ^ (h >> 2);
+    h = hash_size_t(m->table.growth_left) ^ (h << 6) ^ (h >> 2);
+    h = hash_size_t(m->min_size) ^ (h << 6) ^ (h >> 2);
     return h;
 }
 
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "hash_map.h"
+
+/* Layout shared by hash_map.c and hash_map_io.c, not part of the public API */
+#define HASH_MAP_MIN_SIZE 32
+#define GROUP_SIZE 16
+#define MIN_MAX_LOAD 0.25f
+#define MAX_MAX_LOAD 0.9375f
+
+/* Struct's declarations */
+typedef struct hash_table_t
+{
+    size_t size;
+    size_t growth_left;
+    uint8_t *status;
+    size_t *hashes;
+    void *keys;
+    void *container;
+    int mapped;
+} hash_table_t;
+
+typedef struct hash_map_t
+{
+    size_t count;
+    size_t min_size;
+    size_t seed;
+    float max_load;
+    int incremental;
+    int cache_hashes;
+    int robin_hood;
+    const type_func *keys_type;
+    const type_func *container_type;
+    hash_table_t table;
+    hash_table_t old;
+    size_t migrated;
+    /* Owned by hash_map_io.c, released through unmap by free_hash_map */
+    void *mapping;
+    void (*unmap)(void *const mapping);
+    int read_only;
+} hash_map_t;
+
+/* Function's declarations */
+void migrate_hash_map(hash_map_t *const m, size_t steps);
+const type_func *values_type_hash_map(const type_func *const container_type);
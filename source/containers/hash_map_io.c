@@ -0,0 +1,295 @@
+#include "hash_map_io.h"
+#include "hash_map_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define FILE_MAGIC "HASHMAP"
+#define FILE_VERSION 1
+#define FILE_BYTE_ORDER 0x0102030405060708ULL
+#define FILE_ALIGN 64
+
+/* Struct's declarations */
+/* On-disk header, followed by the status, hashes, keys and container arrays at FILE_ALIGN offsets */
+typedef struct hash_map_file_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t word_size;
+    uint64_t byte_order;
+    uint64_t key_size;
+    uint64_t value_size;
+    uint64_t size;
+    uint64_t count;
+    uint64_t growth_left;
+    uint64_t min_size;
+    uint64_t seed;
+    uint64_t status_offset;
+    uint64_t hashes_offset;
+    uint64_t keys_offset;
+    uint64_t container_offset;
+    uint64_t file_size;
+    float max_load;
+    uint32_t cache_hashes;
+    uint32_t robin_hood;
+} hash_map_file_t;
+
+typedef struct hash_map_mapping_t
+{
+    void *data;
+    size_t size;
+} hash_map_mapping_t;
+
+/* Static function's declarations */
+static hash_map_mapping_t *map_file_hash_map(const char *const path, const int writable);
+static void unmap_file_hash_map(void *const mapping);
+static int replace_file_hash_map(const char *const src, const char *const dest);
+static int write_block_hash_map(FILE *const file, const void *const data, const size_t len, uint64_t *const pos);
+static int check_block_hash_map(const uint64_t offset, const uint64_t count, const uint64_t width, const uint64_t file_size);
+static int check_header_hash_map(const hash_map_file_t *const h, const size_t key_size, const size_t value_size, const size_t file_size);
+
+/* Main functions */
+/* Keys and values must be trivially copyable: the arrays are written byte for byte.
+   The file is written next to path and renamed over it, so live mappings of the old file stay valid
+   (on Windows the rename fails instead while the old file is still mapped) */
+int save_hash_map(hash_map const ptr, const char *const path)
+{
+    if (ptr == NULL || path == NULL)
+        return 0;
+    hash_map_t *m = data_shared_ptr(ptr);
+    migrate_hash_map(m, m->old.size);
+    const hash_table_t *t = &m->table;
+    const size_t key_size = m->keys_type->t_size;
+    const size_t value_size = m->container_type->t_size;
+    hash_map_file_t h = {
+        .magic = FILE_MAGIC,
+        .version = FILE_VERSION,
+        .word_size = sizeof(size_t),
+        .byte_order = FILE_BYTE_ORDER,
+        .key_size = key_size,
+        .value_size = value_size,
+        .size = t->size,
+        .count = m->count,
+        .growth_left = t->growth_left,
+        .min_size = m->min_size,
+        .seed = m->seed,
+        .max_load = m->max_load,
+        .cache_hashes = m->cache_hashes,
+        .robin_hood = m->robin_hood};
+    size_t path_len = strlen(path);
+    char *tmp_path = malloc(path_len + sizeof(".tmp"));
+    if (tmp_path == NULL)
+        return 0;
+    memcpy(tmp_path, path, path_len);
+    memcpy(tmp_path + path_len, ".tmp", sizeof(".tmp"));
+    FILE *file = fopen(tmp_path, "wb");
+    if (file == NULL)
+    {
+        free(tmp_path);
+        return 0;
+    }
+    /* First pass lays out the offsets, second pass writes the data */
+    int ok = 1;
+    int pass = 0;
+    for (; pass < 2 && ok; pass++)
+    {
+        uint64_t pos = 0;
+        FILE *out = pass == 0 ? NULL : file;
+        ok = write_block_hash_map(out, &h, sizeof(h), &pos);
+        h.status_offset = pos;
+        ok = ok && write_block_hash_map(out, t->status, t->size, &pos);
+        h.hashes_offset = m->cache_hashes ? pos : 0;
+        if (m->cache_hashes)
+            ok = ok && write_block_hash_map(out, t->hashes, t->size * sizeof(size_t), &pos);
+        h.keys_offset = pos;
+        ok = ok && write_block_hash_map(out, t->keys, t->size * key_size, &pos);
+        h.container_offset = value_size != 0 ? pos : 0;
+        if (value_size != 0)
+            ok = ok && write_block_hash_map(out, t->container, t->size * value_size, &pos);
+        h.file_size = pos;
+    }
+    ok = fclose(file) == 0 && ok;
+    ok = ok && replace_file_hash_map(tmp_path, path);
+    if (ok == 0)
+        remove(tmp_path);
+    free(tmp_path);
+    return ok;
+}
+
+/* Maps a save_hash_map file: lookups run straight off the page cache, no rebuild.
+   Read-only maps reject every modification; writable maps are copy-on-write and never touch the file */
+hash_map map_hash_map(const char *const path, const type_func *const keys_type, const type_func *const container_type, const int writable)
+{
+    if (path == NULL || keys_type == NULL)
+        return NULL;
+    const type_func *values_type = values_type_hash_map(container_type);
+    hash_map_mapping_t *mapping = map_file_hash_map(path, writable);
+    if (mapping == NULL)
+        return NULL;
+    const hash_map_file_t *h = mapping->data;
+    if (check_header_hash_map(h, keys_type->t_size, values_type->t_size, mapping->size) == 0)
+    {
+        unmap_file_hash_map(mapping);
+        return NULL;
+    }
+    hash_map ptr = malloc_shared_ptr(1, sizeof(hash_map_t));
+    if (ptr == NULL)
+    {
+        unmap_file_hash_map(mapping);
+        return NULL;
+    }
+    uint8_t *base = mapping->data;
+    hash_map_t new_m = {
+        .count = h->count,
+        .min_size = h->min_size,
+        .seed = h->seed,
+        .max_load = h->max_load,
+        .incremental = 0,
+        .cache_hashes = h->cache_hashes,
+        .robin_hood = h->robin_hood,
+        .keys_type = keys_type,
+        .container_type = values_type,
+        .table = {
+            .size = h->size,
+            .growth_left = h->growth_left,
+            .status = base + h->status_offset,
+            .hashes = h->cache_hashes ? (size_t *)(base + h->hashes_offset) : NULL,
+            .keys = base + h->keys_offset,
+            .container = h->value_size != 0 ? base + h->container_offset : NULL,
+            .mapped = 1},
+        .old = {0},
+        .migrated = 0,
+        .mapping = mapping,
+        .unmap = unmap_file_hash_map,
+        .read_only = writable == 0};
+    memcpy(data_shared_ptr(ptr), &new_m, sizeof(hash_map_t));
+    return ptr;
+}
+
+/* Static functions */
+
+/* Private (copy-on-write) mapping of the whole file; writable only makes the pages writable in memory */
+static hash_map_mapping_t *map_file_hash_map(const char *const path, const int writable)
+{
+    hash_map_mapping_t *mapping = malloc(sizeof(hash_map_mapping_t));
+    if (mapping == NULL)
+        return NULL;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER file_size;
+    if (file == INVALID_HANDLE_VALUE || GetFileSizeEx(file, &file_size) == 0 ||
+        (uint64_t)file_size.QuadPart < sizeof(hash_map_file_t) || (uint64_t)file_size.QuadPart > SIZE_MAX)
+    {
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        free(mapping);
+        return NULL;
+    }
+    /* The view keeps the section and the file alive, both handles can go right away */
+    HANDLE section = CreateFileMappingA(file, NULL, writable ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    mapping->data = section != NULL ? MapViewOfFile(section, writable ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (section != NULL)
+        CloseHandle(section);
+    if (mapping->data == NULL)
+    {
+        free(mapping);
+        return NULL;
+    }
+    mapping->size = (size_t)file_size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(hash_map_file_t))
+    {
+        if (fd >= 0)
+            close(fd);
+        free(mapping);
+        return NULL;
+    }
+    mapping->size = st.st_size;
+    mapping->data = mmap(NULL, mapping->size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping->data == MAP_FAILED)
+    {
+        free(mapping);
+        return NULL;
+    }
+#endif
+    return mapping;
+}
+
+static void unmap_file_hash_map(void *const mapping)
+{
+    hash_map_mapping_t *m = mapping;
+#ifdef _WIN32
+    UnmapViewOfFile(m->data);
+#else
+    munmap(m->data, m->size);
+#endif
+    free(m);
+    return;
+}
+
+/* rename() on msvcrt refuses to overwrite an existing file */
+static int replace_file_hash_map(const char *const src, const char *const dest)
+{
+#ifdef _WIN32
+    return MoveFileExA(src, dest, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(src, dest) == 0;
+#endif
+}
+
+/* Writes data padded to FILE_ALIGN; with a NULL file only advances pos */
+static int write_block_hash_map(FILE *const file, const void *const data, const size_t len, uint64_t *const pos)
+{
+    static const uint8_t zeros[FILE_ALIGN] = {0};
+    size_t pad = (FILE_ALIGN - len % FILE_ALIGN) % FILE_ALIGN;
+    *pos += len + pad;
+    if (file == NULL)
+        return 1;
+    return fwrite(data, 1, len, file) == len && fwrite(zeros, 1, pad, file) == pad;
+}
+
+static int check_block_hash_map(const uint64_t offset, const uint64_t count, const uint64_t width, const uint64_t file_size)
+{
+    if (offset % FILE_ALIGN != 0 || offset > file_size)
+        return 0;
+    return count <= (file_size - offset) / width;
+}
+
+static int check_header_hash_map(const hash_map_file_t *const h, const size_t key_size, const size_t value_size, const size_t file_size)
+{
+    if (memcmp(h->magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 || h->version != FILE_VERSION)
+        return 0;
+    if (h->word_size != sizeof(size_t) || h->byte_order != FILE_BYTE_ORDER || h->file_size != file_size)
+        return 0;
+    if (h->key_size != key_size || h->value_size != value_size)
+        return 0;
+    if (h->size < GROUP_SIZE || (h->size & (h->size - 1)) != 0 || h->count > h->size || h->growth_left > h->size - h->count)
+        return 0;
+    if (h->min_size < HASH_MAP_MIN_SIZE || (h->min_size & (h->min_size - 1)) != 0)
+        return 0;
+    /* Written as a positive range test so a NaN max_load is rejected too */
+    if (!(h->max_load >= MIN_MAX_LOAD && h->max_load <= MAX_MAX_LOAD) || (h->robin_hood && h->cache_hashes == 0))
+        return 0;
+    if (h->growth_left + h->count > (uint64_t)(h->size * h->max_load))
+        return 0;
+    if (check_block_hash_map(h->status_offset, h->size, 1, file_size) == 0 ||
+        check_block_hash_map(h->keys_offset, h->size, key_size, file_size) == 0)
+        return 0;
+    if (h->cache_hashes && check_block_hash_map(h->hashes_offset, h->size, sizeof(size_t), file_size) == 0)
+        return 0;
+    if (value_size != 0 && check_block_hash_map(h->container_offset, h->size, value_size, file_size) == 0)
+        return 0;
+    return 1;
+}
@@ -0,0 +1,141 @@
+#include "hash_set.h"
+
+/* Struct's declarations */
+typedef struct for_each_ctx_t
+{
+    hash_set_func func;
+    void *context;
+} for_each_ctx_t;
+
+/* Static function's declarations */
+static void for_each_key_hash_set(const void *const key, void *const val, void *const context);
+static int insert_all_hash_set(hash_set const dest, const hash_set src);
+
+/* Main functions */
+/* A hash_map without a value array: keys share the probing core, no container is allocated */
+hash_set create_hash_set(const size_t size, const type_func *const keys_type)
+{
+    return create_hash_map(size, keys_type, NULL);
+}
+
+void free_hash_set(hash_set const s)
+{
+    free_hash_map(s);
+    return;
+}
+
+/* Returns 1 if the key was added, 2 if it was already present, 0 on failure */
+int insert_hash_set(hash_set const s, const void *const key)
+{
+    return emplace_hash_map(s, key, NULL);
+}
+
+int contains_hash_set(const hash_set s, const void *const key)
+{
+    return has_key_hash_map(s, key);
+}
+
+int erase_hash_set(hash_set const s, const void *const key)
+{
+    return delete_hash_map(s, key, NULL);
+}
+
+size_t count_hash_set(const hash_set s)
+{
+    return count_hash_map(s);
+}
+
+int reserve_hash_set(hash_set const s, const size_t count)
+{
+    return reserve_hash_map(s, count);
+}
+
+int next_hash_set(const hash_set s, hash_set_iter_t *const it, void **const key)
+{
+    return next_hash_map(s, it, key, NULL);
+}
+
+int for_each_hash_set(const hash_set s, hash_set_func func, void *const context)
+{
+    if (func == NULL)
+        return 0;
+    for_each_ctx_t ctx = {.func = func, .context = context};
+    return for_each_hash_map(s, for_each_key_hash_set, &ctx);
+}
+
+int export_hash_set(const hash_set s, vector const keys)
+{
+    return export_hash_map(s, keys, NULL);
+}
+
+hash_set union_hash_set(const hash_set a, const hash_set b)
+{
+    if (a == NULL || b == NULL)
+        return NULL;
+    const type_func *keys_type = keys_type_hash_map(a);
+    if (keys_type != keys_type_hash_map(b))
+        return NULL;
+    hash_set s = create_hash_set(0, keys_type);
+    if (s == NULL)
+        return NULL;
+    /* Sized for the worst case up front so no insert below rehashes */
+    if (reserve_hash_map(s, count_hash_map(a) + count_hash_map(b)) == 0 ||
+        insert_all_hash_set(s, a) == 0 || insert_all_hash_set(s, b) == 0)
+    {
+        free_hash_set(s);
+        return NULL;
+    }
+    return s;
+}
+
+/* Walks the smaller set and probes the larger one */
+hash_set intersect_hash_set(const hash_set a, const hash_set b)
+{
+    if (a == NULL || b == NULL)
+        return NULL;
+    const type_func *keys_type = keys_type_hash_map(a);
+    if (keys_type != keys_type_hash_map(b))
+        return NULL;
+    hash_set small = count_hash_map(a) <= count_hash_map(b) ? a : b;
+    hash_set large = small == a ? b : a;
+    hash_set s = create_hash_set(0, keys_type);
+    if (s == NULL)
+        return NULL;
+    if (reserve_hash_map(s, count_hash_map(small)) == 0)
+    {
+        free_hash_set(s);
+        return NULL;
+    }
+    hash_set_iter_t it = {0};
+    void *key = NULL;
+    while (next_hash_set(small, &it, &key))
+    {
+        if (has_key_hash_map(large, key) && emplace_hash_map(s, key, NULL) == 0)
+        {
+            free_hash_set(s);
+            return NULL;
+        }
+    }
+    return s;
+}
+
+/* Static functions */
+static void for_each_key_hash_set(const void *const key, void *const val, void *const context)
+{
+    (void)val;
+    for_each_ctx_t *ctx = context;
+    ctx->func(key, ctx->context);
+    return;
+}
+
+static int insert_all_hash_set(hash_set const dest, const hash_set src)
+{
+    hash_set_iter_t it = {0};
+    void *key = NULL;
+    while (next_hash_set(src, &it, &key))
+    {
+        if (emplace_hash_map(dest, key, NULL) == 0)
+            return 0;
+    }
+    return 1;
+}
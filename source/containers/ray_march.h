@@ -0,0 +1,88 @@
+#pragma once
+#include "svo.h"
+#include <math.h>
+#include <assert.h>
+
+/* Internal helpers shared by the svo and brickmap ray casts: both walk the grid in the same way and only differ in how big an empty box they may skip */
+
+#define RAY_EPSILON 1e-6
+
+typedef struct ray_march_t
+{
+    double origin[3];
+    double direction[3];
+    double inv_direction[3];
+    double t;
+    double t_max;
+} ray_march_t;
+
+static inline double ray_exit(const double *const origin, const double *const inv_direction, const double *const box_min, const double *const box_max)
+{
+    double t_exit = INFINITY;
+    int8_t axis;
+    for (axis = 0; axis < 3; axis++)
+    {
+        if (isinf(inv_direction[axis]))
+            continue;
+        const double bound = inv_direction[axis] > 0.0 ? box_max[axis] : box_min[axis];
+        t_exit = fmin(t_exit, (bound - origin[axis]) * inv_direction[axis]);
+    }
+    return t_exit;
+}
+
+static inline double ray_enter(const double *const origin, const double *const inv_direction, const double *const box_min, const double *const box_max)
+{
+    double t_enter = 0.0;
+    int8_t axis;
+    for (axis = 0; axis < 3; axis++)
+    {
+        if (isinf(inv_direction[axis]))
+        {
+            if (origin[axis] < box_min[axis] || origin[axis] >= box_max[axis])
+                return INFINITY;
+            continue;
+        }
+        const double bound = inv_direction[axis] > 0.0 ? box_min[axis] : box_max[axis];
+        t_enter = fmax(t_enter, (bound - origin[axis]) * inv_direction[axis]);
+    }
+    return t_enter;
+}
+
+/* Normalizes the direction and clips the ray against the [0, extent) grid, t > t_max means it misses */
+static inline ray_march_t ray_march(const double *const origin, const double *const direction, const point_t extent, const float max_dist)
+{
+    ray_march_t ray;
+    double length = 0.0;
+    int8_t axis;
+    for (axis = 0; axis < 3; axis++)
+        length += direction[axis] * direction[axis];
+    length = sqrt(length);
+    assert(length > 0.0);
+    for (axis = 0; axis < 3; axis++)
+    {
+        ray.origin[axis] = origin[axis];
+        ray.direction[axis] = direction[axis] / length;
+        ray.inv_direction[axis] = ray.direction[axis] != 0.0 ? 1.0 / ray.direction[axis] : INFINITY;
+    }
+    const double grid_min[3] = {0.0, 0.0, 0.0};
+    const double grid_max[3] = {extent.x, extent.y, extent.z};
+    ray.t_max = fmin((double)max_dist, ray_exit(ray.origin, ray.inv_direction, grid_min, grid_max));
+    ray.t = ray_enter(ray.origin, ray.inv_direction, grid_min, grid_max);
+    if (ray.t > 0.0)
+        ray.t += RAY_EPSILON;
+    return ray;
+}
+
+static inline point_t ray_march_point(const ray_march_t *const ray)
+{
+    return POINT((int32_t)floor(ray->origin[0] + ray->direction[0] * ray->t),
+                 (int32_t)floor(ray->origin[1] + ray->direction[1] * ray->t),
+                 (int32_t)floor(ray->origin[2] + ray->direction[2] * ray->t));
+}
+
+/* Moves the ray just past the far side of an empty box containing the current point */
+static inline void ray_march_skip(ray_march_t *const ray, const double *const box_min, const double *const box_max)
+{
+    ray->t = fmax(ray_exit(ray->origin, ray->inv_direction, box_min, box_max), ray->t) + RAY_EPSILON;
+    return;
+}
@@ -1,5 +1,6 @@
 #include "rbt_map.h"
 #include "util_funcs.h"
+#include "string_type.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -55,7 +56,7 @@ static int minimum_node(rbt_map_t *const m, size_t x_index);
 static int maximum_node(rbt_map_t *const m, size_t x_index);
 static void transplant_node(rbt_map_t *const m, const size_t u_index, const size_t v_index);
 static void delete_fixup(rbt_map_t *const m, size_t x_index);
-static size_t get_index_rbt_map(const rbt_map_t *const m, const void *const key);
+static size_t get_index_rbt_map(const rbt_map_t *const m, const void *const key, int (*cmp)(const void *const, const void *const));
 
 /* Main functions */
 rbt_map create_rbt_map(const size_t size, const type_func *const keys_type, const type_func *const container_type)
@@ -152,7 +153,7 @@ int set_rbt_map(rbt_map const ptr, const void *const key, const void *const val)
         }
         else
         {
-            if (cmp_result == -1)
+            if (cmp_result < 0)
                 x = x_node->left;
             else
                 x = x_node->right;
@@ -170,7 +171,7 @@ int set_rbt_map(rbt_map const ptr, const void *const key, const void *const val)
     {
         rbt_node *y_node = node_from_pool(m, y);
         int cmp_result = m->pool.keys_type->t_cmp(m->pool.keys_type->t_at(m->pool.keys, z_index), m->pool.keys_type->t_at(m->pool.keys, y));
-        if (cmp_result == -1)
+        if (cmp_result < 0)
             y_node->left = z_index;
         else
             y_node->right = z_index;
@@ -190,7 +191,7 @@ int has_key_rbt_map(const rbt_map ptr, const void *const key)
     if (key == NULL)
         return 0;
     else
-        return get_index_rbt_map(m, key) != m->nil;
+        return get_index_rbt_map(m, key, m->pool.keys_type->t_cmp) != m->nil;
 }
 
 int get_rbt_map(const rbt_map ptr, const void *const key, void *const val)
@@ -200,7 +201,34 @@ int get_rbt_map(const rbt_map ptr, const void *const key, void *const val)
     rbt_map_t *m = data_shared_ptr(ptr);
     if (key == NULL || val == NULL || m->pool.count <= 1)
         return 0;
-    size_t z_index = get_index_rbt_map(m, key);
+    size_t z_index = get_index_rbt_map(m, key, m->pool.keys_type->t_cmp);
+    if (z_index == m->nil)
+        return 0;
+    m->pool.container_type->t_cpy(val, m->pool.container_type->t_at(m->pool.container, z_index));
+    return 1;
+}
+
+int has_key_str_rbt_map(const rbt_map ptr, const char *const key, const size_t len)
+{
+    if (ptr == NULL)
+        return 0;
+    rbt_map_t *m = data_shared_ptr(ptr);
+    if (key == NULL || m->pool.keys_type != f_string_t)
+        return 0;
+    string_view_t view = {.str = key, .len = len};
+    return get_index_rbt_map(m, &view, cmp_string_view) != m->nil;
+}
+
+/* Looks up a f_string_t keyed map with borrowed characters, no string_t needed */
+int get_str_rbt_map(const rbt_map ptr, const char *const key, const size_t len, void *const val)
+{
+    if (ptr == NULL)
+        return 0;
+    rbt_map_t *m = data_shared_ptr(ptr);
+    if (key == NULL || val == NULL || m->pool.count <= 1 || m->pool.keys_type != f_string_t)
+        return 0;
+    string_view_t view = {.str = key, .len = len};
+    size_t z_index = get_index_rbt_map(m, &view, cmp_string_view);
     if (z_index == m->nil)
         return 0;
     m->pool.container_type->t_cpy(val, m->pool.container_type->t_at(m->pool.container, z_index));
@@ -214,7 +242,7 @@ int delete_rbt_map(rbt_map const ptr, const void *const key, void *const val)
     rbt_map_t *m = data_shared_ptr(ptr);
     if (key == NULL || m->pool.count <= 1)
         return 0;
-    size_t z_index = get_index_rbt_map(m, key);
+    size_t z_index = get_index_rbt_map(m, key, m->pool.keys_type->t_cmp);
     if (z_index == m->nil)
         return 0;
     rbt_node *z = node_from_pool(m, z_index);
@@ -694,16 +722,16 @@ static void delete_fixup(rbt_map_t *const m, size_t x_index)
     return;
 }
 
-static size_t get_index_rbt_map(const rbt_map_t *const m, const void *const key)
+static size_t get_index_rbt_map(const rbt_map_t *const m, const void *const key, int (*cmp)(const void *const, const void *const))
 {
     size_t current = m->root;
     while (current != m->nil)
     {
         rbt_node *node = node_from_pool(m, current);
-        int cmp_result = m->pool.keys_type->t_cmp(m->pool.keys_type->t_at(m->pool.keys, current), key);
+        int cmp_result = cmp(m->pool.keys_type->t_at(m->pool.keys, current), key);
         if (cmp_result == 0)
             return current;
-        else if (cmp_result == 1)
+        else if (cmp_result > 0)
             current = node->left;
         else
             current = node->right;
@@ -1,4 +1,5 @@
 #include "svo.h"
+#include "ray_march.h"
 #include <math.h>
 #include <assert.h>
 #include <stdio.h>
@@ -7,36 +8,62 @@
 
 #define NODES_START_CAPACITY 9
 #define INDEXES_START_CAPACITY 4
+#define NODES_GROW_STEP 32
+#define JOURNAL_START_CAPACITY 64
+#define SEEN_START_CAPACITY 64
 
-#define MAX_GRID_SIZE 1024
-#define MAX_DEPTH 10
-#define MASK_TYPE 0xC0000000U
-#define MASK_EMPTY 0x00000000U
-#define MASK_LEAF 0x40000000U
-#define MASK_NODE 0x80000000U
-#define MASK_CHILDREN 0x3FFFFFFFU
+#define MAX_DEPTH SVO_MAX_DEPTH
+#define MAX_GRID_SIZE (1U << MAX_DEPTH)
+#define TYPE_SHIFT (sizeof(svo_index_t) * 8 - 2)
+#define MASK_TYPE ((svo_index_t)3 << TYPE_SHIFT)
+#define MASK_EMPTY ((svo_index_t)0)
+#define MASK_LEAF ((svo_index_t)1 << TYPE_SHIFT)
+#define MASK_NODE ((svo_index_t)2 << TYPE_SHIFT)
+#define MASK_CHILDREN (~MASK_TYPE)
 #define MASK_COLOR 0x00FFFFFFU
 
+#define EDIT_BLOCK 0
+#define EDIT_COUNT 1
+#define EDIT_PUSH_BACK 2
+#define EDIT_POP_BACK 3
+#define EDIT_PUSH_FRONT 4
+#define EDIT_POP_FRONT 5
+
 #define INVALID_VOXEL VOXEL(AABB(POINT(-1, -1, -1), 0), COLOR(0, 0, 0, 0))
 
+/* Only SVO_COUNTERS builds touch the statistics, so svo_get stays read-only by default */
+#ifdef SVO_COUNTERS
+#define COUNT_EVENT(SVO, EVENT) ((SVO)->counters.EVENT++)
+#define COUNT_QUERY(SVO, DEPTH) record_query(SVO, DEPTH)
+#else
+#define COUNT_EVENT(SVO, EVENT) ((void)0)
+#define COUNT_QUERY(SVO, DEPTH) ((void)(DEPTH))
+#endif // SVO_COUNTERS
+
 static inline svo_nodes_t create_nodes(void)
 {
-    uint32_t *const iroot = calloc(NODES_START_CAPACITY, sizeof(uint32_t));
+    svo_index_t *const iroot = calloc(NODES_START_CAPACITY, sizeof(svo_index_t));
     assert(iroot != 0);
     uint32_t *const croot = calloc(NODES_START_CAPACITY, sizeof(uint32_t));
     assert(croot != 0);
     return (svo_nodes_t){.iroot = iroot,
                          .croot = croot,
+                         .droot = NULL,
+                         .hroot = NULL,
                          .count = 1,
                          .capacity = NODES_START_CAPACITY};
 }
 
 static inline void clear_nodes(svo_nodes_t *const nodes)
 {
-    nodes->iroot = realloc(nodes->iroot, NODES_START_CAPACITY * sizeof(uint32_t));
-    memset(nodes->iroot, 0, NODES_START_CAPACITY * sizeof(uint32_t));
+    nodes->iroot = realloc(nodes->iroot, NODES_START_CAPACITY * sizeof(svo_index_t));
+    memset(nodes->iroot, 0, NODES_START_CAPACITY * sizeof(svo_index_t));
     nodes->croot = realloc(nodes->croot, NODES_START_CAPACITY * sizeof(uint32_t));
     memset(nodes->croot, 0, NODES_START_CAPACITY * sizeof(uint32_t));
+    if (nodes->droot != NULL)
+        nodes->droot = realloc(nodes->droot, NODES_START_CAPACITY * sizeof(uint8_t));
+    if (nodes->hroot != NULL)
+        nodes->hroot = realloc(nodes->hroot, NODES_START_CAPACITY * sizeof(uint64_t));
     nodes->count = 1;
     nodes->capacity = NODES_START_CAPACITY;
     return;
@@ -46,13 +73,19 @@ static inline void free_nodes(svo_nodes_t *const nodes)
 {
     free(nodes->iroot);
     free(nodes->croot);
+    free(nodes->droot);
+    free(nodes->hroot);
     return;
 }
 
 static inline void adjust_nodes(svo_nodes_t *const nodes)
 {
-    nodes->iroot = realloc(nodes->iroot, nodes->count * sizeof(uint32_t));
+    nodes->iroot = realloc(nodes->iroot, nodes->count * sizeof(svo_index_t));
     nodes->croot = realloc(nodes->croot, nodes->count * sizeof(uint32_t));
+    if (nodes->droot != NULL)
+        nodes->droot = realloc(nodes->droot, nodes->count * sizeof(uint8_t));
+    if (nodes->hroot != NULL)
+        nodes->hroot = realloc(nodes->hroot, nodes->count * sizeof(uint64_t));
     nodes->capacity = nodes->count;
     return;
 }
@@ -61,13 +94,26 @@ static inline void increase_nodes(svo_nodes_t *const nodes)
 {
     if (nodes->count + 8 >= nodes->capacity)
     {
-        nodes->capacity += 32;
-        nodes->iroot = realloc(nodes->iroot, nodes->capacity * sizeof(uint32_t));
+        const svo_index_t old_capacity = nodes->capacity;
+        const svo_index_t step = nodes->capacity / 2 > NODES_GROW_STEP ? nodes->capacity / 2 : NODES_GROW_STEP;
+        assert(nodes->capacity <= (svo_index_t)-1 - step);
+        nodes->capacity += step;
+        nodes->iroot = realloc(nodes->iroot, nodes->capacity * sizeof(svo_index_t));
         assert(nodes->iroot != 0);
-        memset(nodes->iroot + nodes->count, 0, 32 * sizeof(uint32_t));
+        memset(nodes->iroot + old_capacity, 0, (nodes->capacity - old_capacity) * sizeof(svo_index_t));
         nodes->croot = realloc(nodes->croot, nodes->capacity * sizeof(uint32_t));
         assert(nodes->croot != 0);
-        memset(nodes->croot + nodes->count, 0, 32 * sizeof(uint32_t));
+        memset(nodes->croot + old_capacity, 0, (nodes->capacity - old_capacity) * sizeof(uint32_t));
+        if (nodes->droot != NULL)
+        {
+            nodes->droot = realloc(nodes->droot, nodes->capacity * sizeof(uint8_t));
+            assert(nodes->droot != 0);
+        }
+        if (nodes->hroot != NULL)
+        {
+            nodes->hroot = realloc(nodes->hroot, nodes->capacity * sizeof(uint64_t));
+            assert(nodes->hroot != 0);
+        }
     }
     nodes->count += 8;
     return;
@@ -75,7 +121,7 @@ static inline void increase_nodes(svo_nodes_t *const nodes)
 
 static inline svo_queue_t create_spare(void)
 {
-    uint32_t *const spare = calloc(INDEXES_START_CAPACITY, sizeof(uint32_t));
+    svo_index_t *const spare = calloc(INDEXES_START_CAPACITY, sizeof(svo_index_t));
     assert(spare != 0);
     return (svo_queue_t){.queue = spare,
                          .count = 0,
@@ -85,8 +131,8 @@ static inline svo_queue_t create_spare(void)
 
 static inline void clear_spare(svo_queue_t *const spare)
 {
-    spare->queue = realloc(spare->queue, INDEXES_START_CAPACITY * sizeof(uint32_t));
-    memset(spare->queue, 0, INDEXES_START_CAPACITY * sizeof(uint32_t));
+    spare->queue = realloc(spare->queue, INDEXES_START_CAPACITY * sizeof(svo_index_t));
+    memset(spare->queue, 0, INDEXES_START_CAPACITY * sizeof(svo_index_t));
     spare->count = 0;
     spare->offset = 0;
     spare->capacity = INDEXES_START_CAPACITY;
@@ -99,48 +145,244 @@ static inline void free_spare(svo_queue_t *const spare)
     return;
 }
 
-static inline void add_spare(svo_queue_t *const spare, const uint32_t index)
+static inline void add_spare(svo_queue_t *const spare, const svo_index_t index)
 {
     spare->queue[(spare->offset + spare->count) % spare->capacity] = index;
     spare->count++;
     if (spare->count == spare->capacity)
     {
-        spare->queue = realloc(spare->queue, spare->capacity * 2);
+        spare->queue = realloc(spare->queue, spare->capacity * 2 * sizeof(svo_index_t));
         assert(spare->queue != 0);
-        memmove(spare->queue + spare->capacity, spare->queue, spare->offset * sizeof(uint32_t));
+        memmove(spare->queue + spare->capacity, spare->queue, spare->offset * sizeof(svo_index_t));
         spare->capacity *= 2;
     }
     return;
 }
 
-static inline uint32_t pop_spare(svo_queue_t *const spare)
+static inline svo_index_t pop_spare(svo_queue_t *const spare)
 {
-    const uint32_t result = spare->queue[spare->offset];
+    const svo_index_t result = spare->queue[spare->offset];
     spare->offset = (spare->offset + 1) % spare->capacity;
     if (--spare->count == 0 && spare->capacity >= 8 * INDEXES_START_CAPACITY)
     {
-        spare->queue = realloc(spare->queue, INDEXES_START_CAPACITY);
+        spare->queue = realloc(spare->queue, INDEXES_START_CAPACITY * sizeof(svo_index_t));
         spare->offset = 0;
+        spare->capacity = INDEXES_START_CAPACITY;
     }
     return result;
 }
 
+static inline void push_front_spare(svo_queue_t *const spare, const svo_index_t index)
+{
+    spare->offset = (spare->offset + spare->capacity - 1) % spare->capacity;
+    spare->queue[spare->offset] = index;
+    spare->count++;
+    if (spare->count == spare->capacity)
+    {
+        spare->queue = realloc(spare->queue, spare->capacity * 2 * sizeof(svo_index_t));
+        assert(spare->queue != 0);
+        memmove(spare->queue + spare->capacity, spare->queue, spare->offset * sizeof(svo_index_t));
+        spare->capacity *= 2;
+    }
+    return;
+}
+
+static inline void clear_journal(svo_journal_t *const journal)
+{
+    journal->count = 0;
+    journal->block_count = 0;
+    journal->stroke_count = 0;
+    return;
+}
+
+static inline void free_journal(svo_journal_t *const journal)
+{
+    free(journal->edits);
+    free(journal->blocks);
+    free(journal->strokes);
+    *journal = (svo_journal_t){0};
+    return;
+}
+
+static inline void push_edit(svo_journal_t *const journal, const uint8_t type, const svo_index_t index)
+{
+    if (journal->count == journal->capacity)
+    {
+        journal->capacity = journal->capacity != 0 ? journal->capacity * 2 : JOURNAL_START_CAPACITY;
+        journal->edits = realloc(journal->edits, journal->capacity * sizeof(svo_edit_t));
+        assert(journal->edits != 0);
+    }
+    svo_edit_t *const edit = journal->edits + journal->count++;
+    edit->type = type;
+    edit->index = index;
+    return;
+}
+
+static inline svo_block_t *push_block(svo_journal_t *const journal, const svo_index_t index)
+{
+    push_edit(journal, EDIT_BLOCK, index);
+    if (journal->block_count == journal->block_capacity)
+    {
+        journal->block_capacity = journal->block_capacity != 0 ? journal->block_capacity * 2 : JOURNAL_START_CAPACITY;
+        journal->blocks = realloc(journal->blocks, journal->block_capacity * sizeof(svo_block_t));
+        assert(journal->blocks != 0);
+    }
+    return journal->blocks + journal->block_count++;
+}
+
+static inline void push_stroke(svo_journal_t *const journal)
+{
+    if (journal->stroke_count == journal->stroke_capacity)
+    {
+        journal->stroke_capacity = journal->stroke_capacity != 0 ? journal->stroke_capacity * 2 : JOURNAL_START_CAPACITY;
+        journal->strokes = realloc(journal->strokes, journal->stroke_capacity * sizeof(svo_index_t));
+        assert(journal->strokes != 0);
+    }
+    journal->strokes[journal->stroke_count++] = journal->count;
+    return;
+}
+
+static inline svo_index_t last_stroke_end(const svo_journal_t *const journal)
+{
+    return journal->stroke_count != 0 ? journal->strokes[journal->stroke_count - 1] : 0;
+}
+
+static inline void clear_seen(svo_history_t *const history)
+{
+    if (history->seen_capacity > SEEN_START_CAPACITY)
+    {
+        free(history->seen);
+        history->seen = NULL;
+        history->seen_capacity = 0;
+    }
+    else if (history->seen != NULL)
+    {
+        memset(history->seen, 0, history->seen_capacity * sizeof(svo_index_t));
+    }
+    history->seen_count = 0;
+    return;
+}
+
+static inline svo_index_t *find_seen(svo_index_t *const seen, const svo_index_t capacity, const svo_index_t key)
+{
+    svo_index_t slot = (key * 0x9E3779B1U) & (capacity - 1);
+    while (seen[slot] != 0 && seen[slot] != key)
+        slot = (slot + 1) & (capacity - 1);
+    return seen + slot;
+}
+
+static bool mark_seen(svo_history_t *const history, const svo_index_t block)
+{
+    if ((history->seen_count + 1) * 2 > history->seen_capacity)
+    {
+        const svo_index_t capacity = history->seen_capacity != 0 ? history->seen_capacity * 2 : SEEN_START_CAPACITY;
+        svo_index_t *const seen = calloc(capacity, sizeof(svo_index_t));
+        assert(seen != 0);
+        svo_index_t i;
+        for (i = 0; i < history->seen_capacity; i++)
+        {
+            if (history->seen[i] != 0)
+                *find_seen(seen, capacity, history->seen[i]) = history->seen[i];
+        }
+        free(history->seen);
+        history->seen = seen;
+        history->seen_capacity = capacity;
+    }
+    svo_index_t *const slot = find_seen(history->seen, history->seen_capacity, block + 1);
+    if (*slot != 0)
+        return false;
+    *slot = block + 1;
+    history->seen_count++;
+    return true;
+}
+
+static inline void clear_history(svo_t *const svo)
+{
+    clear_journal(&svo->history.undo);
+    clear_journal(&svo->history.redo);
+    return;
+}
+
+static inline void capture_block(const svo_t *const svo, svo_journal_t *const journal, const svo_index_t block)
+{
+    svo_block_t *const saved = push_block(journal, block);
+    const svo_index_t slots = block == 0 ? 1 : 8;
+    memcpy(saved->iroot, svo->nodes.iroot + block, slots * sizeof(svo_index_t));
+    memcpy(saved->croot, svo->nodes.croot + block, slots * sizeof(uint32_t));
+    if (svo->nodes.droot != NULL)
+        memcpy(saved->droot, svo->nodes.droot + block, slots * sizeof(uint8_t));
+    if (svo->nodes.hroot != NULL)
+        memcpy(saved->hroot, svo->nodes.hroot + block, slots * sizeof(uint64_t));
+    return;
+}
+
+static inline void restore_block(svo_t *const svo, const svo_index_t block, const svo_block_t *const saved)
+{
+    const svo_index_t slots = block == 0 ? 1 : 8;
+    memcpy(svo->nodes.iroot + block, saved->iroot, slots * sizeof(svo_index_t));
+    memcpy(svo->nodes.croot + block, saved->croot, slots * sizeof(uint32_t));
+    if (svo->nodes.droot != NULL)
+        memcpy(svo->nodes.droot + block, saved->droot, slots * sizeof(uint8_t));
+    if (svo->nodes.hroot != NULL)
+        memcpy(svo->nodes.hroot + block, saved->hroot, slots * sizeof(uint64_t));
+    return;
+}
+
+static inline void record_block(svo_t *const svo, const svo_index_t index)
+{
+    if (svo->history.depth == 0)
+        return;
+    const svo_index_t block = index == 0 ? 0 : index - (index - 1) % 8;
+    if (mark_seen(&svo->history, block) == true)
+        capture_block(svo, &svo->history.undo, block);
+    return;
+}
+
+static inline void record_edit(svo_t *const svo, const uint8_t type, const svo_index_t index)
+{
+    if (svo->history.depth != 0)
+        push_edit(&svo->history.undo, type, index);
+    return;
+}
+
 svo_t svo(const uint32_t grid_size, const uint32_t min_size)
 {
-    assert(grid_size % 2 == 0);
-    assert(grid_size <= MAX_GRID_SIZE);
-    assert(min_size % 2 == 0 || min_size == 1);
-    assert(min_size < grid_size);
+    return svo_box(POINT(grid_size, grid_size, grid_size), min_size);
+}
+
+svo_t svo_box(const point_t extent, const uint32_t min_size)
+{
+    assert(extent.x > 0 && extent.y > 0 && extent.z > 0);
+    int32_t max_extent = extent.x > extent.y ? extent.x : extent.y;
+    max_extent = max_extent > extent.z ? max_extent : extent.z;
+    assert((uint32_t)max_extent <= MAX_GRID_SIZE);
+    uint32_t grid_size = 2;
+    while (grid_size < (uint32_t)max_extent)
+        grid_size *= 2;
+    assert(min_size >= 1 && min_size < grid_size);
+    uint32_t max_depth = 0;
+    while ((grid_size >> max_depth) > min_size)
+        max_depth++;
     return (svo_t){.nodes = create_nodes(),
                    .spare = create_spare(),
+                   .queries = {0},
+                   .counters = {0},
+                   .history = {.enabled = false},
+                   .extent = extent,
                    .grid_size = grid_size,
-                   .max_depth = log2(grid_size / min_size)};
+                   .max_depth = max_depth,
+                   .max_distance = 0};
 }
 
 void svo_clear(svo_t *const svo)
 {
     clear_nodes(&svo->nodes);
     clear_spare(&svo->spare);
+    if (svo->nodes.droot != NULL)
+        svo->nodes.droot[0] = svo->max_distance;
+    svo->queries = (svo_queries_t){0};
+    clear_history(svo);
+    svo->counters = (svo_counters_t){0};
     return;
 }
 
@@ -148,36 +390,52 @@ void svo_free(svo_t *const svo)
 {
     free_nodes(&svo->nodes);
     free_spare(&svo->spare);
+    svo_disable_history(svo);
     return;
 }
 
 void svo_adjust(svo_t *const svo)
 {
+    assert(svo->history.depth == 0);
     adjust_nodes(&svo->nodes);
     clear_spare(&svo->spare);
+    clear_history(svo);
     return;
 }
 
 static inline bool is_in_grid(const svo_t *const svo, const point_t *const point)
 {
-    return (uint32_t)point->x < svo->grid_size &&
-           (uint32_t)point->y < svo->grid_size &&
-           (uint32_t)point->z < svo->grid_size;
+    return (uint32_t)point->x < (uint32_t)svo->extent.x &&
+           (uint32_t)point->y < (uint32_t)svo->extent.y &&
+           (uint32_t)point->z < (uint32_t)svo->extent.z;
 }
 
-static inline uint32_t pack_children(const uint32_t children)
+static inline uint8_t inside_octants(const svo_t *const svo, const point_t *const point, const uint8_t depth)
+{
+    const uint32_t half = svo->grid_size >> (depth + 1);
+    uint8_t octants = 0xFF;
+    if (((uint32_t)point->x & ~(2 * half - 1)) + half >= (uint32_t)svo->extent.x)
+        octants &= 0x0F;
+    if (((uint32_t)point->y & ~(2 * half - 1)) + half >= (uint32_t)svo->extent.y)
+        octants &= 0x33;
+    if (((uint32_t)point->z & ~(2 * half - 1)) + half >= (uint32_t)svo->extent.z)
+        octants &= 0x55;
+    return octants;
+}
+
+static inline svo_index_t pack_children(const svo_index_t children)
 {
     return (children - 1) / 8;
 }
 
-static inline uint32_t unpack_children(const uint32_t node)
+static inline svo_index_t unpack_children(const svo_index_t node)
 {
     return (node & MASK_CHILDREN) * 8 + 1;
 }
 
 static inline uint32_t pack_color(const color_t color)
 {
-    return color.r << 24 | color.g << 16 | color.b << 8 | color.a;
+    return (uint32_t)color.r << 24 | color.g << 16 | color.b << 8 | color.a;
 }
 
 static inline color_t unpack_color(const uint32_t node)
@@ -185,54 +443,102 @@ static inline color_t unpack_color(const uint32_t node)
     return COLOR((node >> 24) & 0xFF, (node >> 16) & 0xFF, (node >> 8) & 0xFF, node & 0xFF);
 }
 
-static inline uint32_t get_type(const svo_t *const svo, const uint32_t index)
+static inline svo_index_t get_type(const svo_t *const svo, const svo_index_t index)
 {
     return svo->nodes.iroot[index] & MASK_TYPE;
 }
 
-static inline uint32_t get_children(const svo_t *const svo, const uint32_t index)
+static inline svo_index_t get_children(const svo_t *const svo, const svo_index_t index)
 {
     return unpack_children(svo->nodes.iroot[index]);
 }
 
-static inline color_t get_color(const svo_t *const svo, const uint32_t index)
+static inline color_t get_color(const svo_t *const svo, const svo_index_t index)
 {
     return unpack_color(svo->nodes.croot[index]);
 }
 
-static inline uint32_t get_raw_color(const svo_t *const svo, const uint32_t index)
+static inline uint32_t get_raw_color(const svo_t *const svo, const svo_index_t index)
 {
     return svo->nodes.croot[index];
 }
 
-static inline void set_empty(const svo_t *const svo, const uint32_t index)
+static inline void set_empty(svo_t *const svo, const svo_index_t index)
 {
+    record_block(svo, index);
     svo->nodes.iroot[index] = MASK_EMPTY;
     svo->nodes.croot[index] = 0x0;
     return;
 }
 
-static inline void set_children(const svo_t *const svo, const uint32_t index, const uint32_t children)
+static inline void set_children(const svo_t *const svo, const svo_index_t index, const svo_index_t children)
 {
     svo->nodes.iroot[index] = MASK_NODE | pack_children(children);
     return;
 }
 
-static inline void set_color(svo_t *const svo, const uint32_t index, const color_t color)
+static inline void set_color(svo_t *const svo, const svo_index_t index, const color_t color)
 {
+    record_block(svo, index);
     svo->nodes.iroot[index] = MASK_LEAF;
     svo->nodes.croot[index] = pack_color(color);
     return;
 }
 
-static inline void set_raw_color(svo_t *const svo, const uint32_t index, const uint32_t raw_color)
+static inline void set_raw_color(svo_t *const svo, const svo_index_t index, const uint32_t raw_color)
 {
+    record_block(svo, index);
     svo->nodes.iroot[index] = MASK_LEAF;
     svo->nodes.croot[index] = raw_color;
     return;
 }
 
-static inline void swap_nodes(svo_t *const svo, const uint32_t index_1, const uint32_t index_2)
+static inline uint8_t get_valid_mask(const svo_t *const svo, const svo_index_t index)
+{
+    return svo->nodes.croot[index] & 0xFF;
+}
+
+static inline uint8_t get_leaf_mask(const svo_t *const svo, const svo_index_t index)
+{
+    return (svo->nodes.croot[index] >> 8) & 0xFF;
+}
+
+static inline uint8_t get_node_mask(const svo_t *const svo, const svo_index_t index)
+{
+    return get_valid_mask(svo, index) & ~get_leaf_mask(svo, index);
+}
+
+static inline void set_node(svo_t *const svo, const svo_index_t index, const svo_index_t children, const uint8_t valid_mask, const uint8_t leaf_mask)
+{
+    record_block(svo, index);
+    svo->nodes.iroot[index] = MASK_NODE | pack_children(children);
+    svo->nodes.croot[index] = (uint32_t)leaf_mask << 8 | valid_mask;
+    return;
+}
+
+static inline void mark_child(svo_t *const svo, const svo_index_t parent, const int8_t octant, const svo_index_t node_type)
+{
+    const uint32_t valid_bit = 1U << octant;
+    const uint32_t leaf_bit = valid_bit << 8;
+    record_block(svo, parent);
+    uint32_t masks = svo->nodes.croot[parent];
+    if (node_type == MASK_EMPTY)
+        masks &= ~(valid_bit | leaf_bit);
+    else if (node_type == MASK_LEAF)
+        masks |= valid_bit | leaf_bit;
+    else
+        masks = (masks | valid_bit) & ~leaf_bit;
+    svo->nodes.croot[parent] = masks;
+    return;
+}
+
+static inline int8_t next_octant(const uint8_t mask, const int8_t octant)
+{
+    const uint32_t rest = ((uint32_t)mask >> octant) << octant;
+    return rest == 0 ? 8 : __builtin_ctz(rest);
+}
+
+static inline void swap_nodes(svo_t *const svo, const svo_index_t index_1, const svo_index_t index_2)
 {
     svo->nodes.iroot[index_1] ^= svo->nodes.iroot[index_2];
     svo->nodes.iroot[index_2] ^= svo->nodes.iroot[index_1];
@@ -240,27 +546,62 @@ static inline void swap_nodes(svo_t *const svo, const uint32_t index_1, const ui
     svo->nodes.croot[index_1] ^= svo->nodes.croot[index_2];
     svo->nodes.croot[index_2] ^= svo->nodes.croot[index_1];
     svo->nodes.croot[index_1] ^= svo->nodes.croot[index_2];
+    if (svo->nodes.droot != NULL)
+    {
+        const uint8_t distance = svo->nodes.droot[index_1];
+        svo->nodes.droot[index_1] = svo->nodes.droot[index_2];
+        svo->nodes.droot[index_2] = distance;
+    }
+    if (svo->nodes.hroot != NULL)
+    {
+        const uint64_t hash = svo->nodes.hroot[index_1];
+        svo->nodes.hroot[index_1] = svo->nodes.hroot[index_2];
+        svo->nodes.hroot[index_2] = hash;
+    }
     return;
 }
 
-static inline uint32_t ask_for_index(svo_t *const svo)
+static inline svo_index_t ask_for_index(svo_t *const svo)
 {
     if (svo->spare.count != 0)
     {
-        return pop_spare(&svo->spare);
+        const svo_index_t index = pop_spare(&svo->spare);
+        record_edit(svo, EDIT_PUSH_FRONT, index);
+        return index;
     }
     else
     {
-        const uint32_t index = svo->nodes.count;
+        const svo_index_t index = svo->nodes.count;
+        record_edit(svo, EDIT_COUNT, index);
         increase_nodes(&svo->nodes);
         return index;
     }
 }
 
-static inline void add_to_spare(svo_t *const svo, const uint32_t index)
+static inline void add_to_spare(svo_t *const svo, const svo_index_t index)
 {
-    memset(svo->nodes.iroot + index, 0, 8 * sizeof(uint32_t));
+    record_block(svo, index);
+    memset(svo->nodes.iroot + index, 0, 8 * sizeof(svo_index_t));
     add_spare(&svo->spare, index);
+    record_edit(svo, EDIT_POP_BACK, index);
+    return;
+}
+
+static inline void update_aabb_down(aabb_t *const aabb, const int8_t octant)
+{
+    aabb->offset /= 2;
+    aabb->point.x += (octant & 4) ? aabb->offset : 0;
+    aabb->point.y += (octant & 2) ? aabb->offset : 0;
+    aabb->point.z += (octant & 1) ? aabb->offset : 0;
+    return;
+}
+
+static inline void update_aabb_up(aabb_t *const aabb, const int8_t octant)
+{
+    aabb->point.x -= (octant & 4) ? aabb->offset : 0;
+    aabb->point.y -= (octant & 2) ? aabb->offset : 0;
+    aabb->point.z -= (octant & 1) ? aabb->offset : 0;
+    aabb->offset *= 2;
     return;
 }
 
@@ -289,67 +630,260 @@ static inline int8_t find_octant_and_update_aabb(aabb_t *const aabb, const point
     return octant;
 }
 
+static inline void record_query(svo_t *const svo, const uint32_t depth)
+{
+    if (svo->queries.count == SVO_QUERY_WINDOW)
+    {
+        svo->queries.count /= 2;
+        svo->queries.depth_sum /= 2;
+    }
+    svo->queries.count++;
+    svo->queries.depth_sum += depth;
+    return;
+}
+
 voxel_t svo_get(svo_t *const svo, const point_t point)
 {
     if (is_in_grid(svo, &point) == false)
         return INVALID_VOXEL;
     aabb_t aabb = AABB(POINT(0, 0, 0), svo->grid_size);
-    uint32_t i = 0;
+    svo_index_t i = 0;
+    uint32_t depth = 0;
     while (1)
     {
-        const uint32_t node_type = get_type(svo, i);
+        const svo_index_t node_type = get_type(svo, i);
         if (node_type == MASK_LEAF)
+        {
+            COUNT_QUERY(svo, depth);
             return VOXEL(aabb, get_color(svo, i));
+        }
         else if (node_type == MASK_EMPTY)
+        {
+            COUNT_QUERY(svo, depth);
             return INVALID_VOXEL;
+        }
         const int8_t octant = find_octant_and_update_aabb(&aabb, &point);
         i = get_children(svo, i) + octant;
+        depth++;
     }
 }
 
-void svo_set(svo_t *const svo, const point_t point, const color_t color)
+static void release_children(svo_t *const svo, const svo_index_t index)
 {
-    if (is_in_grid(svo, &point) == false)
+    svo_index_t block_stack[7 * MAX_DEPTH + 1];
+    uint32_t stack_size = 1;
+    block_stack[0] = get_children(svo, index);
+    while (stack_size > 0)
+    {
+        const svo_index_t block = block_stack[--stack_size];
+        int8_t octant;
+        for (octant = 0; octant < 8; octant++)
+        {
+            if (get_type(svo, block + octant) == MASK_NODE)
+                block_stack[stack_size++] = get_children(svo, block + octant);
+        }
+        add_to_spare(svo, block);
+    }
+    return;
+}
+
+typedef struct svo_cell_t
+{
+    svo_index_t index;
+    aabb_t aabb;
+} svo_cell_t;
+
+static inline int64_t box_gap(const aabb_t *const aabb_1, const aabb_t *const aabb_2)
+{
+    int64_t gap = 0;
+    int8_t axis;
+    for (axis = 0; axis < 3; axis++)
+    {
+        const int64_t before = (int64_t)aabb_2->point.raw[axis] - ((int64_t)aabb_1->point.raw[axis] + aabb_1->offset);
+        const int64_t after = (int64_t)aabb_1->point.raw[axis] - ((int64_t)aabb_2->point.raw[axis] + aabb_2->offset);
+        gap = before > gap ? before : gap;
+        gap = after > gap ? after : gap;
+    }
+    return gap;
+}
+
+static inline void set_distance(svo_t *const svo, const svo_index_t index, const uint8_t distance)
+{
+    if (svo->nodes.droot != NULL)
+    {
+        record_block(svo, index);
+        svo->nodes.droot[index] = distance;
+    }
+    return;
+}
+
+static uint8_t nearest_filled(const svo_t *const svo, const aabb_t *const aabb)
+{
+    svo_cell_t cell_stack[7 * MAX_DEPTH + 1];
+    uint32_t stack_size = 1;
+    cell_stack[0] = (svo_cell_t){.index = 0, .aabb = AABB(POINT(0, 0, 0), svo->grid_size)};
+    int64_t distance = svo->max_distance;
+    while (stack_size > 0)
+    {
+        const svo_cell_t cell = cell_stack[--stack_size];
+        const int64_t gap = box_gap(&cell.aabb, aabb);
+        if (gap >= distance)
+            continue;
+        const svo_index_t node_type = get_type(svo, cell.index);
+        if (node_type == MASK_LEAF)
+        {
+            distance = gap;
+        }
+        else if (node_type == MASK_NODE)
+        {
+            const svo_index_t children = get_children(svo, cell.index);
+            const uint8_t valid_mask = get_valid_mask(svo, cell.index);
+            int8_t octant;
+            for (octant = next_octant(valid_mask, 0); octant < 8; octant = next_octant(valid_mask, octant + 1))
+            {
+                cell_stack[stack_size] = (svo_cell_t){.index = children + octant, .aabb = cell.aabb};
+                update_aabb_down(&cell_stack[stack_size].aabb, octant);
+                stack_size++;
+            }
+        }
+    }
+    return distance;
+}
+
+static void update_distances(svo_t *const svo, const aabb_t *const aabb, const bool filled)
+{
+    svo_cell_t cell_stack[7 * MAX_DEPTH + 1];
+    uint32_t stack_size = 1;
+    cell_stack[0] = (svo_cell_t){.index = 0, .aabb = AABB(POINT(0, 0, 0), svo->grid_size)};
+    while (stack_size > 0)
+    {
+        const svo_cell_t cell = cell_stack[--stack_size];
+        const int64_t gap = box_gap(&cell.aabb, aabb);
+        if (gap >= svo->max_distance)
+            continue;
+        const svo_index_t node_type = get_type(svo, cell.index);
+        if (node_type == MASK_EMPTY)
+        {
+            if (filled == true && svo->nodes.droot[cell.index] > gap)
+                set_distance(svo, cell.index, gap);
+            else if (filled == false && svo->nodes.droot[cell.index] >= gap)
+                set_distance(svo, cell.index, nearest_filled(svo, &cell.aabb));
+        }
+        else if (node_type == MASK_NODE)
+        {
+            const svo_index_t children = get_children(svo, cell.index);
+            int8_t octant;
+            for (octant = 0; octant < 8; octant++)
+            {
+                cell_stack[stack_size] = (svo_cell_t){.index = children + octant, .aabb = cell.aabb};
+                update_aabb_down(&cell_stack[stack_size].aabb, octant);
+                stack_size++;
+            }
+        }
+    }
+    return;
+}
+
+static inline uint64_t mix_hash(uint64_t hash)
+{
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+static inline uint64_t get_hash(const svo_t *const svo, const svo_index_t index)
+{
+    const svo_index_t node_type = get_type(svo, index);
+    if (node_type == MASK_LEAF)
+        return mix_hash((uint64_t)1 << 32 | get_raw_color(svo, index));
+    else if (node_type == MASK_NODE)
+        return svo->nodes.hroot[index];
+    return 0;
+}
+
+static inline uint64_t children_hash(const svo_t *const svo, const svo_index_t index)
+{
+    const svo_index_t children = get_children(svo, index);
+    uint64_t hash = 0x9E3779B97F4A7C15ULL;
+    int8_t octant;
+    for (octant = 0; octant < 8; octant++)
+    {
+        hash = mix_hash(hash ^ get_hash(svo, children + octant));
+    }
+    return hash;
+}
+
+static inline void update_hashes(svo_t *const svo, const svo_index_t *const parent_stack, uint8_t count)
+{
+    if (svo->nodes.hroot == NULL)
         return;
-    uint32_t parent_stack[MAX_DEPTH] = {0};
+    while (count-- > 0)
+    {
+        record_block(svo, parent_stack[count]);
+        svo->nodes.hroot[parent_stack[count]] = children_hash(svo, parent_stack[count]);
+    }
+    return;
+}
+
+static inline bool is_uniform(const svo_t *const svo, const svo_index_t parent, const uint8_t inside, const uint32_t packed_color)
+{
+    if ((get_leaf_mask(svo, parent) & inside) != inside)
+        return false;
+    const svo_index_t children = get_children(svo, parent);
+    int8_t octant;
+    for (octant = next_octant(inside, 0); octant < 8; octant = next_octant(inside, octant + 1))
+    {
+        if (get_raw_color(svo, children + octant) != packed_color)
+            return false;
+    }
+    return true;
+}
+
+static void set_cell(svo_t *const svo, const point_t point, const uint8_t depth, const uint32_t packed_color)
+{
+    svo_index_t parent_stack[MAX_DEPTH] = {0};
+    int8_t octant_stack[MAX_DEPTH] = {0};
     aabb_t aabb = AABB(POINT(0, 0, 0), svo->grid_size);
-    const uint32_t packed_color = color.r << 24 | color.g << 16 | color.b << 8 | color.a;
-    uint32_t i = 0;
+    svo_index_t i = 0;
     uint8_t cur_depth = 0;
     while (1)
     {
-        if (cur_depth == svo->max_depth)
+        if (cur_depth == depth)
         {
+            if (get_type(svo, i) == MASK_NODE)
+                release_children(svo, i);
             set_raw_color(svo, i, packed_color);
             while (i != 0)
             {
                 cur_depth--;
-                const uint32_t children = get_children(svo, parent_stack[cur_depth]);
-                int8_t octant = 0;
-                while (get_type(svo, children + octant) == MASK_LEAF &&
-                       get_raw_color(svo, children + octant) == packed_color &&
-                       octant < 8)
+                const svo_index_t parent = parent_stack[cur_depth];
+                mark_child(svo, parent, octant_stack[cur_depth], MASK_LEAF);
+                if (is_uniform(svo, parent, inside_octants(svo, &point, cur_depth), packed_color) == false)
                 {
-                    octant++;
-                }
-                if (octant != 8)
+                    update_hashes(svo, parent_stack, cur_depth + 1);
                     return;
-                add_to_spare(svo, children);
-                i = parent_stack[cur_depth];
+                }
+                add_to_spare(svo, get_children(svo, parent));
+                COUNT_EVENT(svo, collapses);
+                i = parent;
                 set_raw_color(svo, i, packed_color);
             }
             return;
         }
         else
         {
-            const uint32_t node_type = get_type(svo, i);
+            const svo_index_t node_type = get_type(svo, i);
             if (node_type == MASK_LEAF)
             {
                 const uint32_t node_color = get_raw_color(svo, i);
                 if (node_color == packed_color)
                     return;
-                const uint32_t children = ask_for_index(svo);
-                set_children(svo, i, children);
+                const svo_index_t children = ask_for_index(svo);
+                set_node(svo, i, children, 0xFF, 0xFF);
+                COUNT_EVENT(svo, splits);
                 int8_t octant;
                 for (octant = 0; octant < 8; octant++)
                 {
@@ -358,88 +892,139 @@ void svo_set(svo_t *const svo, const point_t point, const color_t color)
             }
             else if (node_type == MASK_EMPTY)
             {
-                const uint32_t children = ask_for_index(svo);
-                set_children(svo, i, children);
+                const svo_index_t children = ask_for_index(svo);
+                set_node(svo, i, children, 0x00, 0x00);
+                if (svo->nodes.droot != NULL)
+                {
+                    record_block(svo, children);
+                    memset(svo->nodes.droot + children, svo->nodes.droot[i], 8 * sizeof(uint8_t));
+                }
             }
+            if (node_type != MASK_NODE && cur_depth != 0)
+                mark_child(svo, parent_stack[cur_depth - 1], octant_stack[cur_depth - 1], MASK_NODE);
+            const int8_t octant = find_octant_and_update_aabb(&aabb, &point);
             parent_stack[cur_depth] = i;
+            octant_stack[cur_depth] = octant;
             cur_depth++;
-            const int8_t octant = find_octant_and_update_aabb(&aabb, &point);
             i = get_children(svo, i) + octant;
         }
     }
 }
 
-void svo_unset(svo_t *const svo, const point_t point)
+void svo_set(svo_t *const svo, const point_t point, const color_t color)
 {
     if (is_in_grid(svo, &point) == false)
         return;
-    uint32_t parent_stack[MAX_DEPTH] = {0};
+    COUNT_EVENT(svo, sets);
+    svo_begin_edit(svo);
+    set_cell(svo, point, svo->max_depth, pack_color(color));
+    if (svo->nodes.droot != NULL)
+        update_distances(svo, &AABB(point, svo->grid_size >> svo->max_depth), true);
+    svo_end_edit(svo);
+    return;
+}
+
+void svo_fill(svo_t *const svo, const aabb_t aabb, const color_t color)
+{
+    if (is_in_grid(svo, &aabb.point) == false)
+        return;
+    uint8_t depth = 0;
+    while (depth < svo->max_depth && (svo->grid_size >> depth) > aabb.offset)
+        depth++;
+    assert((svo->grid_size >> depth) == aabb.offset || depth == svo->max_depth);
+    COUNT_EVENT(svo, sets);
+    svo_begin_edit(svo);
+    set_cell(svo, aabb.point, depth, pack_color(color));
+    if (svo->nodes.droot != NULL)
+        update_distances(svo, &aabb, true);
+    svo_end_edit(svo);
+    return;
+}
+
+static void unset_cell(svo_t *const svo, const point_t point)
+{
+    svo_index_t parent_stack[MAX_DEPTH] = {0};
+    int8_t octant_stack[MAX_DEPTH] = {0};
     aabb_t aabb = AABB(POINT(0, 0, 0), svo->grid_size);
-    uint32_t i = 0;
+    svo_index_t i = 0;
     uint8_t cur_depth = 0;
     while (1)
     {
         if (cur_depth == svo->max_depth)
         {
             set_empty(svo, i);
+            set_distance(svo, i, 0);
             while (i != 0)
             {
                 cur_depth--;
-                const uint32_t children = get_children(svo, parent_stack[cur_depth]);
-                int8_t octant = 0;
-                while (get_type(svo, children + octant) == MASK_EMPTY &&
-                       octant < 8)
+                const svo_index_t parent = parent_stack[cur_depth];
+                mark_child(svo, parent, octant_stack[cur_depth], MASK_EMPTY);
+                if ((get_valid_mask(svo, parent) & inside_octants(svo, &point, cur_depth)) != 0)
                 {
-                    octant++;
+                    update_hashes(svo, parent_stack, cur_depth + 1);
+                    break;
                 }
-                if (octant != 8)
-                    return;
-                add_to_spare(svo, children);
-                i = parent_stack[cur_depth];
+                add_to_spare(svo, get_children(svo, parent));
+                COUNT_EVENT(svo, collapses);
+                i = parent;
                 set_empty(svo, i);
+                set_distance(svo, i, 0);
             }
+            if (svo->nodes.droot != NULL)
+                update_distances(svo, &AABB(point, svo->grid_size >> svo->max_depth), false);
             return;
         }
         else
         {
-            const uint32_t node_type = get_type(svo, i);
+            const svo_index_t node_type = get_type(svo, i);
             if (node_type == MASK_EMPTY)
                 return;
             else if (node_type == MASK_LEAF)
             {
                 const uint32_t node_color = get_raw_color(svo, i);
-                const uint32_t children = ask_for_index(svo);
-                set_children(svo, i, children);
+                const svo_index_t children = ask_for_index(svo);
+                set_node(svo, i, children, 0xFF, 0xFF);
+                COUNT_EVENT(svo, splits);
                 int8_t octant;
                 for (octant = 0; octant < 8; octant++)
                 {
                     set_raw_color(svo, children + octant, node_color);
                 }
+                if (cur_depth != 0)
+                    mark_child(svo, parent_stack[cur_depth - 1], octant_stack[cur_depth - 1], MASK_NODE);
             }
+            const int8_t octant = find_octant_and_update_aabb(&aabb, &point);
             parent_stack[cur_depth] = i;
+            octant_stack[cur_depth] = octant;
             cur_depth++;
-            const int8_t octant = find_octant_and_update_aabb(&aabb, &point);
             i = get_children(svo, i) + octant;
         }
     }
 }
 
-static uint32_t *get_parent_indexes(const svo_t *const svo)
+void svo_unset(svo_t *const svo, const point_t point)
+{
+    if (is_in_grid(svo, &point) == false)
+        return;
+    COUNT_EVENT(svo, unsets);
+    svo_begin_edit(svo);
+    unset_cell(svo, point);
+    svo_end_edit(svo);
+    return;
+}
+
+static svo_index_t *get_parent_indexes(const svo_t *const svo)
 {
-    uint32_t *const parent_indexes = calloc(svo->nodes.capacity, sizeof(uint32_t));
+    svo_index_t *const parent_indexes = calloc(svo->nodes.capacity, sizeof(svo_index_t));
     assert(parent_indexes != 0);
-    uint32_t parent_stack[MAX_DEPTH] = {0};
-    uint32_t i = 0;
-    int8_t octant_stack[MAX_DEPTH] = {0};
+    svo_index_t parent_stack[MAX_DEPTH] = {0};
+    svo_index_t i = 0;
+    int8_t octant_stack[MAX_DEPTH + 1] = {0};
     uint8_t cur_depth = 0;
     while (1)
     {
-        const uint32_t children = get_children(svo, i);
-        while (get_type(svo, children + octant_stack[cur_depth]) != MASK_NODE &&
-               octant_stack[cur_depth] < 8)
-        {
-            octant_stack[cur_depth]++;
-        }
+        const svo_index_t children = get_children(svo, i);
+        octant_stack[cur_depth] = next_octant(get_node_mask(svo, i), octant_stack[cur_depth]);
         if (octant_stack[cur_depth] < 8)
         {
             parent_stack[cur_depth] = i;
@@ -468,19 +1053,36 @@ static uint32_t *get_parent_indexes(const svo_t *const svo)
     }
 }
 
+static inline void relink_children(const svo_t *const svo, svo_index_t *const parent_indexes, const svo_index_t block)
+{
+    int8_t octant;
+    for (octant = 0; octant < 8; octant++)
+    {
+        if (get_type(svo, block + octant) != MASK_NODE)
+            continue;
+        const svo_index_t children = get_children(svo, block + octant);
+        int8_t child;
+        for (child = 0; child < 8; child++)
+        {
+            parent_indexes[children + child] = block + octant;
+        }
+    }
+    return;
+}
+
 void svo_optimize(svo_t *const svo)
 {
-    if (get_type(svo, 0) == MASK_EMPTY)
+    if (get_type(svo, 0) != MASK_NODE)
         return;
-    uint32_t *const parent_indexes = get_parent_indexes(svo);
-    uint32_t parent_stack[MAX_DEPTH] = {0};
-    uint32_t i = 0;
-    uint32_t children_ideal = 1;
-    int8_t octant_stack[MAX_DEPTH] = {0};
+    svo_index_t *const parent_indexes = get_parent_indexes(svo);
+    svo_index_t parent_stack[MAX_DEPTH] = {0};
+    svo_index_t i = 0;
+    svo_index_t children_ideal = 1;
+    int8_t octant_stack[MAX_DEPTH + 1] = {0};
     uint8_t cur_depth = 0;
     while (1)
     {
-        const uint32_t node_type = get_type(svo, i);
+        const svo_index_t node_type = get_type(svo, i);
         if (node_type == MASK_LEAF)
         {
             cur_depth--;
@@ -489,7 +1091,7 @@ void svo_optimize(svo_t *const svo)
         }
         else
         {
-            const uint32_t children_1 = get_children(svo, i);
+            const svo_index_t children_1 = get_children(svo, i);
             if (octant_stack[cur_depth] == 0)
             {
                 if (children_1 != children_ideal)
@@ -503,25 +1105,30 @@ void svo_optimize(svo_t *const svo)
                         parent_indexes[children_1 + octant] ^= parent_indexes[children_ideal + octant];
                     }
                     set_children(svo, i, children_ideal);
-                    if (parent_indexes[children_1] != 0)
+                    svo_index_t parent = parent_indexes[children_1];
+                    if (parent >= children_1 && parent < children_1 + 8)
                     {
-                        if (get_type(svo, parent_indexes[children_1]) == MASK_NODE)
+                        parent = parent - children_1 + children_ideal;
+                        for (octant = 0; octant < 8; octant++)
                         {
-                            set_children(svo, parent_indexes[children_1], children_1);
+                            parent_indexes[children_1 + octant] = parent;
                         }
                     }
+                    if (parent != 0 && get_type(svo, parent) == MASK_NODE)
+                    {
+                        set_children(svo, parent, children_1);
+                    }
+                    relink_children(svo, parent_indexes, children_ideal);
+                    relink_children(svo, parent_indexes, children_1);
                 }
                 children_ideal += 8;
             }
-            while (get_type(svo, children_1 + octant_stack[cur_depth]) == MASK_EMPTY &&
-                   octant_stack[cur_depth] < 8)
-            {
-                octant_stack[cur_depth]++;
-            }
+            const svo_index_t children = get_children(svo, i);
+            octant_stack[cur_depth] = next_octant(get_valid_mask(svo, i), octant_stack[cur_depth]);
             if (octant_stack[cur_depth] < 8)
             {
                 parent_stack[cur_depth] = i;
-                i = children_1 + octant_stack[cur_depth];
+                i = children + octant_stack[cur_depth];
                 cur_depth++;
                 octant_stack[cur_depth] = 0;
             }
@@ -530,6 +1137,7 @@ void svo_optimize(svo_t *const svo)
                 if (i == 0)
                 {
                     free(parent_indexes);
+                    svo->nodes.count = children_ideal;
                     svo_adjust(svo);
                     return;
                 }
@@ -544,46 +1152,31 @@ void svo_optimize(svo_t *const svo)
     }
 }
 
-static inline void update_aabb_down(aabb_t *const aabb, const int8_t octant)
-{
-    aabb->offset /= 2;
-    aabb->point.x += (octant & 4) ? aabb->offset : 0;
-    aabb->point.y += (octant & 2) ? aabb->offset : 0;
-    aabb->point.z += (octant & 1) ? aabb->offset : 0;
-    return;
-}
-
-static inline void update_aabb_up(aabb_t *const aabb, const int8_t octant)
-{
-    aabb->point.x -= (octant & 4) ? aabb->offset : 0;
-    aabb->point.y -= (octant & 2) ? aabb->offset : 0;
-    aabb->point.z -= (octant & 1) ? aabb->offset : 0;
-    aabb->offset *= 2;
-    return;
-}
-
 void svo_print(svo_t *const svo)
 {
     if (get_type(svo, 0) == MASK_EMPTY)
         return;
-    printf("Octree:\nGrid size: %d\nMax depth: %d\nNode count: %d\nCapacity: %d\n",
+    printf("Octree:\nExtent: %d, %d, %d\nGrid size: %d\nMax depth: %d\nNode count: %llu\nCapacity: %llu\n",
+           svo->extent.x,
+           svo->extent.y,
+           svo->extent.z,
            svo->grid_size,
            svo->max_depth,
-           svo->nodes.count,
-           svo->nodes.capacity);
+           (unsigned long long)svo->nodes.count,
+           (unsigned long long)svo->nodes.capacity);
     aabb_t aabb = AABB(POINT(0, 0, 0), svo->grid_size);
-    uint32_t parent_stack[MAX_DEPTH] = {0};
-    uint32_t i = 0;
-    int8_t octant_stack[MAX_DEPTH] = {0};
+    svo_index_t parent_stack[MAX_DEPTH] = {0};
+    svo_index_t i = 0;
+    int8_t octant_stack[MAX_DEPTH + 1] = {0};
     uint8_t cur_depth = 0;
     while (1)
     {
-        const uint32_t node_type = get_type(svo, i);
+        const svo_index_t node_type = get_type(svo, i);
         if (node_type == MASK_LEAF)
         {
             const color_t color = get_color(svo, i);
-            printf("index: %d | xyz: %d, %d, %d | size: %d | rgba: %d, %d, %d, %d\n",
-                   i,
+            printf("index: %llu | xyz: %d, %d, %d | size: %d | rgba: %d, %d, %d, %d\n",
+                   (unsigned long long)i,
                    aabb.point.x,
                    aabb.point.y,
                    aabb.point.z,
@@ -599,12 +1192,8 @@ void svo_print(svo_t *const svo)
         }
         else
         {
-            const uint32_t children = get_children(svo, i);
-            while (get_type(svo, children + octant_stack[cur_depth]) == MASK_EMPTY &&
-                   octant_stack[cur_depth] < 8)
-            {
-                octant_stack[cur_depth]++;
-            }
+            const svo_index_t children = get_children(svo, i);
+            octant_stack[cur_depth] = next_octant(get_valid_mask(svo, i), octant_stack[cur_depth]);
             if (octant_stack[cur_depth] < 8)
             {
                 parent_stack[cur_depth] = i;
@@ -631,172 +1220,392 @@ void svo_print(svo_t *const svo)
     }
 }
 
-// static inline float pow2f(const float x)
-// {
-//     return x * x;
-// }
-
-// static inline void normalized_vec3(float *const vec3)
-// {
-//     const float length = sqrtf(pow2f(vec3[0]) + pow2f(vec3[1]) + pow2f(vec3[2]));
-//     assert(length > 1e-5);
-//     int32_t i;
-//     for (i = 0; i < 3; i++)
-//     {
-//         vec3[i] /= length;
-//     }
-//     return;
-// }
-
-// static inline bool ray_intersect_aabb(
-//     const float *const position,
-//     const float size,
-//     const float *const start,
-//     const float *const direction,
-//     const float *const inv_direction,
-//     float *const t_min,
-//     float *const t_max)
-// {
-//     float tmin = 0.0;
-//     float tmax = __FLT_MAX__;
-//     int32_t i;
-//     for (i = 0; i < 3; i++)
-//     {
-//         if (direction[i] == 0.0f)
-//         {
-//             if (start[i] < position[i] || start[i] > position[i] + size)
-//                 return false;
-//             continue;
-//         }
-//         const float distance = position[i] - start[i];
-//         float t0 = distance * inv_direction[i];
-//         float t1 = (distance + size) * inv_direction[i];
-//         if (inv_direction[i] < 0.0f)
-//         {
-//             float tmp = t0;
-//             t0 = t1;
-//             t1 = tmp;
-//         }
-//         tmin = fmaxf(tmin, t0);
-//         tmax = fminf(tmax, t1);
-//         if (tmax < tmin)
-//             return false;
-//     }
-//     *t_min = tmin;
-//     *t_max = tmax;
-//     return true;
-// }
-
-// static const uint8_t traversal_order[8][8] = {
-//     // sign = (0,0,0)
-//     {0, 1, 2, 3, 4, 5, 6, 7},
-//     // sign = (0,0,1)
-//     {1, 0, 3, 2, 5, 4, 7, 6},
-//     // sign = (0,1,0)
-//     {2, 3, 0, 1, 6, 7, 4, 5},
-//     // sign = (0,1,1)
-//     {3, 2, 1, 0, 7, 6, 5, 4},
-//     // sign = (1,0,0)
-//     {4, 5, 6, 7, 0, 1, 2, 3},
-//     // sign = (1,0,1)
-//     {5, 4, 7, 6, 1, 0, 3, 2},
-//     // sign = (1,1,0)
-//     {6, 7, 4, 5, 2, 3, 0, 1},
-//     // sign = (1,1,1)
-//     {7, 6, 5, 4, 3, 2, 1, 0}};
-
-// ray_hit_t svo_ray_cast(const svo_t *const ot, const point_t start, const point_t end, float max_dist)
-// {
-//     ray_hit_t result = {
-//         .distance = __FLT_MAX__,
-//         .voxel = INVALID_VOXEL,
-//         .hit = false};
-//     float direction[3] = {
-//         end.x - start.x,
-//         end.y - start.y,
-//         end.z - start.z};
-//     normalized_vec3(direction);
-//     const float inv_direction[3] = {
-//         1.0f / direction[0],
-//         1.0f / direction[1],
-//         1.0f / direction[2]};
-//     float t_min;
-//     float t_max;
-//     if (ray_intersect_aabb((float[3]){0.0f, 0.0f, 0.0f},
-//                            ot->grid_size,
-//                            (float[3]){start.x, start.y, start.z},
-//                            direction,
-//                            inv_direction,
-//                            &t_min,
-//                            &t_max) == false)
-//         return result;
-//     if (t_min > max_dist || t_max < 0.0f)
-//         return result;
-//     typedef struct stack_item_t
-//     {
-//         const svo_node_t *node;
-//         point_t pos;
-//         uint32_t size;
-//         float t_min;
-//     } stack_item_t;
-//     stack_item_t stack[MAX_DEPTH * 8 + 4];
-//     int32_t stack_size = 1;
-//     stack[0] = (stack_item_t){
-//         .node = ot->root,
-//         .pos = POINT(0, 0, 0),
-//         .size = ot->grid_size,
-//         .t_min = t_min};
-//     const int8_t sign_x = (direction[0] < 0.0f);
-//     const int8_t sign_y = (direction[1] < 0.0f);
-//     const int8_t sign_z = (direction[2] < 0.0f);
-//     const int8_t sign_index = sign_x << 2 | sign_y << 1 | sign_z;
-//     const uint8_t *order = traversal_order[sign_index];
-//     while (stack_size > 0)
-//     {
-//         stack_size--;
-//         stack_item_t item = stack[stack_size];
-//         if (item.t_min >= result.distance)
-//             continue;
-//         const uint32_t node_type = item.node[0] & MASK_TYPE;
-//         if (node_type == MASK_LEAF)
-//         {
-//             result.distance = item.t_min;
-//             result.voxel.position = item.pos;
-//             result.voxel.color = unpack_color(item.node[0]);
-//             result.voxel.size = item.size;
-//             result.hit = true;
-//             continue;
-//         }
-//         else if (node_type == MASK_EMPTY)
-//             continue;
-//         const svo_node_t *children = ot->root + unpack_index(item.node[0]);
-//         const uint32_t half = item.size / 2;
-//         int8_t i;
-//         for (i = 7; i >= 0; i--)
-//         {
-//             const int8_t octant = order[i];
-//             const point_t child_pos = POINT(item.pos.x + (octant & 4 ? half : 0),
-//                                             item.pos.y + (octant & 2 ? half : 0),
-//                                             item.pos.z + (octant & 1 ? half : 0));
-//             float t_child_min;
-//             float t_child_max;
-//             if (ray_intersect_aabb((float[3]){child_pos.x, child_pos.y, child_pos.z},
-//                                    half,
-//                                    (float[3]){start.x, start.y, start.z},
-//                                    direction,
-//                                    inv_direction,
-//                                    &t_child_min,
-//                                    &t_child_max) == true &&
-//                 t_child_min <= max_dist && t_child_min < result.distance)
-//             {
-//                 stack[stack_size] = (stack_item_t){
-//                     .node = children + octant,
-//                     .pos = child_pos,
-//                     .size = half,
-//                     .t_min = t_child_min};
-//                 stack_size++;
-//             }
-//         }
-//     }
-//     return result;
-// }
+void svo_walk(const svo_t *const svo, svo_walk_func walk_func, void *const context)
+{
+    const svo_index_t root_type = get_type(svo, 0);
+    if (root_type == MASK_EMPTY)
+        return;
+    aabb_t aabb = AABB(POINT(0, 0, 0), svo->grid_size);
+    if (root_type == MASK_LEAF)
+    {
+        const voxel_t voxel = VOXEL(aabb, get_color(svo, 0));
+        walk_func(&voxel, context);
+        return;
+    }
+    svo_index_t parent_stack[MAX_DEPTH] = {0};
+    svo_index_t i = 0;
+    int8_t octant_stack[MAX_DEPTH + 1] = {0};
+    uint8_t cur_depth = 0;
+    while (1)
+    {
+        octant_stack[cur_depth] = next_octant(get_valid_mask(svo, i), octant_stack[cur_depth]);
+        if (octant_stack[cur_depth] < 8)
+        {
+            const int8_t octant = octant_stack[cur_depth];
+            const svo_index_t child = get_children(svo, i) + octant;
+            update_aabb_down(&aabb, octant);
+            if ((get_leaf_mask(svo, i) >> octant) & 1)
+            {
+                const voxel_t voxel = VOXEL(aabb, get_color(svo, child));
+                walk_func(&voxel, context);
+                update_aabb_up(&aabb, octant);
+                octant_stack[cur_depth]++;
+            }
+            else
+            {
+                parent_stack[cur_depth] = i;
+                i = child;
+                cur_depth++;
+                octant_stack[cur_depth] = 0;
+            }
+        }
+        else
+        {
+            if (i == 0)
+                return;
+            cur_depth--;
+            i = parent_stack[cur_depth];
+            update_aabb_up(&aabb, octant_stack[cur_depth]);
+            octant_stack[cur_depth]++;
+        }
+    }
+}
+
+svo_stats_t svo_stats(const svo_t *const svo)
+{
+    svo_stats_t stats = {0};
+    svo_index_t index_stack[7 * MAX_DEPTH + 1];
+    uint8_t depth_stack[7 * MAX_DEPTH + 1];
+    uint32_t stack_size = 1;
+    index_stack[0] = 0;
+    depth_stack[0] = 0;
+    const svo_index_t root_type = get_type(svo, 0);
+    if (root_type == MASK_EMPTY)
+    {
+        stats.levels[0].empty++;
+        stats.empty++;
+        stack_size = 0;
+    }
+    else if (root_type == MASK_LEAF)
+    {
+        stats.levels[0].leaves++;
+        stats.leaves++;
+        stack_size = 0;
+    }
+    while (stack_size > 0)
+    {
+        stack_size--;
+        const svo_index_t i = index_stack[stack_size];
+        const uint8_t depth = depth_stack[stack_size];
+        const uint8_t valid_mask = get_valid_mask(svo, i);
+        const uint8_t leaf_mask = get_leaf_mask(svo, i);
+        const uint8_t node_mask = valid_mask & ~leaf_mask;
+        stats.levels[depth].nodes++;
+        stats.nodes++;
+        stats.levels[depth + 1].empty += 8 - __builtin_popcount(valid_mask);
+        stats.levels[depth + 1].leaves += __builtin_popcount(leaf_mask);
+        const svo_index_t children = get_children(svo, i);
+        int8_t octant;
+        for (octant = next_octant(node_mask, 0); octant < 8; octant = next_octant(node_mask, octant + 1))
+        {
+            index_stack[stack_size] = children + octant;
+            depth_stack[stack_size] = depth + 1;
+            stack_size++;
+        }
+    }
+    uint32_t depth;
+    for (depth = 1; depth <= svo->max_depth; depth++)
+    {
+        stats.empty += stats.levels[depth].empty;
+        stats.leaves += stats.levels[depth].leaves;
+    }
+    stats.spare = svo->spare.count;
+    stats.count = svo->nodes.count;
+    stats.capacity = svo->nodes.capacity;
+    stats.fill_ratio = (float)svo->nodes.count / svo->nodes.capacity;
+    stats.bytes = sizeof(svo_t) +
+                  svo->nodes.capacity * (sizeof(svo_index_t) + sizeof(uint32_t)) +
+                  svo->spare.capacity * sizeof(svo_index_t) +
+                  (svo->nodes.droot != NULL ? svo->nodes.capacity * sizeof(uint8_t) : 0) +
+                  (svo->nodes.hroot != NULL ? svo->nodes.capacity * sizeof(uint64_t) : 0) +
+                  (svo->history.undo.capacity + svo->history.redo.capacity) * sizeof(svo_edit_t) +
+                  (svo->history.undo.block_capacity + svo->history.redo.block_capacity) * sizeof(svo_block_t);
+    stats.average_depth = svo->queries.count != 0
+                              ? (float)svo->queries.depth_sum / svo->queries.count
+                              : 0.0f;
+    stats.counters = svo->counters;
+    return stats;
+}
+
+static void apply_stroke(svo_t *const svo, svo_journal_t *const from, svo_journal_t *const to)
+{
+    from->stroke_count--;
+    const svo_index_t first = last_stroke_end(from);
+    svo_index_t e;
+    for (e = from->count; e-- > first;)
+    {
+        const svo_edit_t *const edit = from->edits + e;
+        if (edit->type == EDIT_BLOCK)
+        {
+            /* Block records are consumed in the same reverse order as the edits */
+            capture_block(svo, to, edit->index);
+            restore_block(svo, edit->index, from->blocks + --from->block_count);
+        }
+        else if (edit->type == EDIT_COUNT)
+        {
+            push_edit(to, EDIT_COUNT, svo->nodes.count);
+            assert(edit->index <= svo->nodes.capacity);
+            if (edit->index < svo->nodes.count)
+            {
+                memset(svo->nodes.iroot + edit->index, 0, (svo->nodes.count - edit->index) * sizeof(svo_index_t));
+                memset(svo->nodes.croot + edit->index, 0, (svo->nodes.count - edit->index) * sizeof(uint32_t));
+            }
+            svo->nodes.count = edit->index;
+        }
+        else if (edit->type == EDIT_PUSH_BACK)
+        {
+            add_spare(&svo->spare, edit->index);
+            push_edit(to, EDIT_POP_BACK, edit->index);
+        }
+        else if (edit->type == EDIT_POP_BACK)
+        {
+            svo->spare.count--;
+            push_edit(to, EDIT_PUSH_BACK, edit->index);
+        }
+        else if (edit->type == EDIT_PUSH_FRONT)
+        {
+            push_front_spare(&svo->spare, edit->index);
+            push_edit(to, EDIT_POP_FRONT, edit->index);
+        }
+        else
+        {
+            pop_spare(&svo->spare);
+            push_edit(to, EDIT_PUSH_FRONT, edit->index);
+        }
+    }
+    from->count = first;
+    push_stroke(to);
+    return;
+}
+
+void svo_enable_hashes(svo_t *const svo)
+{
+    assert(svo->history.depth == 0);
+    clear_history(svo);
+    svo->nodes.hroot = realloc(svo->nodes.hroot, svo->nodes.capacity * sizeof(uint64_t));
+    assert(svo->nodes.hroot != 0);
+    if (get_type(svo, 0) != MASK_NODE)
+        return;
+    svo_index_t *const order = malloc(svo->nodes.count * sizeof(svo_index_t));
+    assert(order != 0);
+    svo_index_t order_count = 1;
+    order[0] = 0;
+    svo_index_t k;
+    for (k = 0; k < order_count; k++)
+    {
+        const svo_index_t children = get_children(svo, order[k]);
+        const uint8_t node_mask = get_node_mask(svo, order[k]);
+        int8_t octant;
+        for (octant = next_octant(node_mask, 0); octant < 8; octant = next_octant(node_mask, octant + 1))
+        {
+            order[order_count++] = children + octant;
+        }
+    }
+    while (order_count-- > 0)
+    {
+        svo->nodes.hroot[order[order_count]] = children_hash(svo, order[order_count]);
+    }
+    free(order);
+    return;
+}
+
+void svo_disable_hashes(svo_t *const svo)
+{
+    assert(svo->history.depth == 0);
+    clear_history(svo);
+    free(svo->nodes.hroot);
+    svo->nodes.hroot = NULL;
+    return;
+}
+
+uint64_t svo_hash(const svo_t *const svo, const aabb_t aabb)
+{
+    assert(svo->nodes.hroot != NULL);
+    if (is_in_grid(svo, &aabb.point) == false)
+        return 0;
+    aabb_t node_aabb = AABB(POINT(0, 0, 0), svo->grid_size);
+    svo_index_t i = 0;
+    while (node_aabb.offset > aabb.offset && get_type(svo, i) == MASK_NODE)
+    {
+        const int8_t octant = find_octant_and_update_aabb(&node_aabb, &aabb.point);
+        i = get_children(svo, i) + octant;
+    }
+    return get_hash(svo, i);
+}
+
+void svo_enable_history(svo_t *const svo)
+{
+    svo->history.enabled = true;
+    return;
+}
+
+void svo_disable_history(svo_t *const svo)
+{
+    assert(svo->history.depth == 0);
+    free_journal(&svo->history.undo);
+    free_journal(&svo->history.redo);
+    free(svo->history.seen);
+    svo->history = (svo_history_t){0};
+    return;
+}
+
+void svo_begin_edit(svo_t *const svo)
+{
+    if (svo->history.enabled == true)
+        svo->history.depth++;
+    return;
+}
+
+void svo_end_edit(svo_t *const svo)
+{
+    if (svo->history.enabled == false)
+        return;
+    assert(svo->history.depth > 0);
+    if (--svo->history.depth != 0)
+        return;
+    clear_seen(&svo->history);
+    if (svo->history.undo.count != last_stroke_end(&svo->history.undo))
+    {
+        push_stroke(&svo->history.undo);
+        clear_journal(&svo->history.redo);
+    }
+    return;
+}
+
+bool svo_undo(svo_t *const svo)
+{
+    if (svo->history.undo.stroke_count == 0)
+        return false;
+    assert(svo->history.depth == 0);
+    apply_stroke(svo, &svo->history.undo, &svo->history.redo);
+    return true;
+}
+
+bool svo_redo(svo_t *const svo)
+{
+    if (svo->history.redo.stroke_count == 0)
+        return false;
+    assert(svo->history.depth == 0);
+    apply_stroke(svo, &svo->history.redo, &svo->history.undo);
+    return true;
+}
+
+void svo_enable_distance(svo_t *const svo, const uint8_t max_distance)
+{
+    assert(max_distance > 0 && svo->history.depth == 0);
+    clear_history(svo);
+    svo->max_distance = max_distance;
+    svo->nodes.droot = realloc(svo->nodes.droot, svo->nodes.capacity * sizeof(uint8_t));
+    assert(svo->nodes.droot != 0);
+    svo_cell_t cell_stack[7 * MAX_DEPTH + 1];
+    uint32_t stack_size = 1;
+    cell_stack[0] = (svo_cell_t){.index = 0, .aabb = AABB(POINT(0, 0, 0), svo->grid_size)};
+    while (stack_size > 0)
+    {
+        const svo_cell_t cell = cell_stack[--stack_size];
+        const svo_index_t node_type = get_type(svo, cell.index);
+        if (node_type == MASK_EMPTY)
+        {
+            svo->nodes.droot[cell.index] = nearest_filled(svo, &cell.aabb);
+        }
+        else if (node_type == MASK_NODE)
+        {
+            const svo_index_t children = get_children(svo, cell.index);
+            int8_t octant;
+            for (octant = 0; octant < 8; octant++)
+            {
+                cell_stack[stack_size] = (svo_cell_t){.index = children + octant, .aabb = cell.aabb};
+                update_aabb_down(&cell_stack[stack_size].aabb, octant);
+                stack_size++;
+            }
+        }
+    }
+    return;
+}
+
+void svo_disable_distance(svo_t *const svo)
+{
+    assert(svo->history.depth == 0);
+    clear_history(svo);
+    free(svo->nodes.droot);
+    svo->nodes.droot = NULL;
+    svo->max_distance = 0;
+    return;
+}
+
+static inline svo_index_t find_node(const svo_t *const svo, const point_t *const point, aabb_t *const aabb)
+{
+    *aabb = AABB(POINT(0, 0, 0), svo->grid_size);
+    svo_index_t i = 0;
+    while (get_type(svo, i) == MASK_NODE)
+    {
+        const int8_t octant = find_octant_and_update_aabb(aabb, point);
+        i = get_children(svo, i) + octant;
+    }
+    return i;
+}
+
+uint32_t svo_distance(const svo_t *const svo, const point_t point)
+{
+    if (is_in_grid(svo, &point) == false || svo->nodes.droot == NULL)
+        return 0;
+    aabb_t aabb;
+    const svo_index_t i = find_node(svo, &point, &aabb);
+    if (get_type(svo, i) != MASK_EMPTY)
+        return 0;
+    return svo->nodes.droot[i];
+}
+
+ray_hit_t svo_ray_trace(const svo_t *const svo, const float *const origin, const float *const direction, const float max_dist)
+{
+    ray_hit_t result = {.distance = __FLT_MAX__,
+                        .voxel = INVALID_VOXEL,
+                        .hit = false};
+    const double start[3] = {origin[0], origin[1], origin[2]};
+    const double unit[3] = {direction[0], direction[1], direction[2]};
+    ray_march_t ray = ray_march(start, unit, svo->extent, max_dist);
+    while (ray.t <= ray.t_max)
+    {
+        const point_t point = ray_march_point(&ray);
+        if (is_in_grid(svo, &point) == false)
+            break;
+        aabb_t aabb;
+        const svo_index_t i = find_node(svo, &point, &aabb);
+        if (get_type(svo, i) == MASK_LEAF)
+        {
+            result.distance = ray.t;
+            result.voxel = VOXEL(aabb, get_color(svo, i));
+            result.hit = true;
+            return result;
+        }
+        const double skip = svo->nodes.droot != NULL ? svo->nodes.droot[i] : 0.0;
+        double box_min[3], box_max[3];
+        int8_t axis;
+        for (axis = 0; axis < 3; axis++)
+        {
+            box_min[axis] = aabb.point.raw[axis] - skip;
+            box_max[axis] = aabb.point.raw[axis] + (double)aabb.offset + skip;
+        }
+        ray_march_skip(&ray, box_min, box_max);
+    }
+    return result;
+}
+
+ray_hit_t svo_ray_cast(const svo_t *const svo, const point_t start, const point_t end, const float max_dist)
+{
+    const float origin[3] = {start.x + 0.5f, start.y + 0.5f, start.z + 0.5f};
+    float direction[3] = {(float)end.x - start.x, (float)end.y - start.y, (float)end.z - start.z};
+    if (direction[0] == 0.0f && direction[1] == 0.0f && direction[2] == 0.0f)
+        direction[0] = 1.0f;
+    return svo_ray_trace(svo, origin, direction, max_dist);
+}
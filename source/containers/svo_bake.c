@@ -0,0 +1,165 @@
+#include "svo_bake.h"
+#include <math.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#define LEAVES_START_CAPACITY 64
+#define BAKE_CHUNK 64
+#define FACE_OFFSET 1e-3f
+
+typedef struct bake_job_t
+{
+    const svo_t *svo;
+    svo_bake_t *bake;
+    uint32_t samples;
+    float radius;
+    uint32_t next;
+} bake_job_t;
+
+typedef struct leaf_list_t
+{
+    voxel_t *leaves;
+    uint32_t count;
+    uint32_t capacity;
+} leaf_list_t;
+
+static void collect_leaf(const voxel_t *const voxel, void *const context)
+{
+    leaf_list_t *const list = context;
+    if (list->count == list->capacity)
+    {
+        list->capacity *= 2;
+        list->leaves = realloc(list->leaves, list->capacity * sizeof(voxel_t));
+        assert(list->leaves != 0);
+    }
+    list->leaves[list->count++] = *voxel;
+    return;
+}
+
+static inline uint64_t next_random(uint64_t *const state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static inline float random_unit(uint64_t *const state)
+{
+    return (next_random(state) >> 40) * (1.0f / 16777216.0f);
+}
+
+static svo_bake_attribute_t bake_leaf(const bake_job_t *const job, const voxel_t *const leaf, uint64_t *const state)
+{
+    svo_bake_attribute_t result = {.occlusion = 0.0f, .sky = 0.0f};
+    uint32_t exposed = 0;
+    int8_t face;
+    for (face = 0; face < 6; face++)
+    {
+        const int8_t normal_axis = face >> 1;
+        const float normal_sign = (face & 1) ? 1.0f : -1.0f;
+        const int8_t tangent_1 = (normal_axis + 1) % 3;
+        const int8_t tangent_2 = (normal_axis + 2) % 3;
+        uint32_t blocked = 0;
+        uint32_t occluded = 0;
+        uint32_t open = 0;
+        uint32_t sample;
+        for (sample = 0; sample < job->samples; sample++)
+        {
+            float origin[3], direction[3];
+            origin[normal_axis] = leaf->aabb.point.raw[normal_axis] +
+                                  ((face & 1) ? leaf->aabb.offset + FACE_OFFSET : -FACE_OFFSET);
+            origin[tangent_1] = leaf->aabb.point.raw[tangent_1] + random_unit(state) * leaf->aabb.offset;
+            origin[tangent_2] = leaf->aabb.point.raw[tangent_2] + random_unit(state) * leaf->aabb.offset;
+            const float u = random_unit(state);
+            const float phi = 2.0f * (float)M_PI * random_unit(state);
+            const float r = sqrtf(u);
+            direction[normal_axis] = normal_sign * sqrtf(1.0f - u);
+            direction[tangent_1] = r * cosf(phi);
+            direction[tangent_2] = r * sinf(phi);
+            if (direction[normal_axis] == 0.0f)
+                direction[normal_axis] = normal_sign * FACE_OFFSET;
+            const ray_hit_t hit = svo_ray_trace(job->svo, origin, direction, __FLT_MAX__);
+            if (hit.hit == false)
+                open++;
+            else if (hit.distance == 0.0f)
+                blocked++;
+            else if (hit.distance <= job->radius)
+                occluded++;
+        }
+        if (blocked == job->samples)
+            continue;
+        exposed++;
+        result.occlusion += (float)(occluded + blocked) / job->samples;
+        result.sky += (float)open / job->samples;
+    }
+    if (exposed == 0)
+        return (svo_bake_attribute_t){.occlusion = 1.0f, .sky = 0.0f};
+    result.occlusion /= exposed;
+    result.sky /= exposed;
+    return result;
+}
+
+static void *bake_worker(void *const argument)
+{
+    bake_job_t *const job = argument;
+    while (1)
+    {
+        const uint32_t first = __atomic_fetch_add(&job->next, BAKE_CHUNK, __ATOMIC_RELAXED);
+        if (first >= job->bake->count)
+            return NULL;
+        const uint32_t last = first + BAKE_CHUNK < job->bake->count ? first + BAKE_CHUNK : job->bake->count;
+        uint32_t i;
+        for (i = first; i < last; i++)
+        {
+            uint64_t state = ((uint64_t)i + 1) * 0x9E3779B97F4A7C15ULL;
+            job->bake->attributes[i] = bake_leaf(job, job->bake->leaves + i, &state);
+        }
+    }
+}
+
+svo_bake_t svo_bake(const svo_t *const svo, const uint32_t samples, const float radius, const uint32_t threads)
+{
+    assert(samples > 0 && threads > 0);
+    leaf_list_t list = {.leaves = malloc(LEAVES_START_CAPACITY * sizeof(voxel_t)),
+                        .count = 0,
+                        .capacity = LEAVES_START_CAPACITY};
+    assert(list.leaves != 0);
+    svo_walk(svo, collect_leaf, &list);
+    svo_bake_t bake = {.leaves = list.leaves,
+                       .attributes = calloc(list.count + 1, sizeof(svo_bake_attribute_t)),
+                       .count = list.count};
+    assert(bake.attributes != 0);
+    bake_job_t job = {.svo = svo,
+                      .bake = &bake,
+                      .samples = samples,
+                      .radius = radius,
+                      .next = 0};
+    pthread_t *const workers = malloc(threads * sizeof(pthread_t));
+    assert(workers != 0);
+    /* Chunks are claimed dynamically, so if a thread fails to start the rest simply pick up its share */
+    uint32_t started = 1;
+    while (started < threads && pthread_create(workers + started, NULL, bake_worker, &job) == 0)
+    {
+        started++;
+    }
+    bake_worker(&job);
+    uint32_t i;
+    for (i = 1; i < started; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    return bake;
+}
+
+void svo_bake_free(svo_bake_t *const bake)
+{
+    free(bake->leaves);
+    free(bake->attributes);
+    bake->leaves = NULL;
+    bake->attributes = NULL;
+    bake->count = 0;
+    return;
+}
@@ -0,0 +1,475 @@
+#include "svo_io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VOX_VERSION 150
+#define VOX_MAX_SIZE 256
+#define VOX_PALETTE_SIZE 256
+#define VOX_BATCH 1024
+#define RAW_BRICK 8
+
+#define CHUNK_ID(A, B, C, D) \
+    ((uint32_t)(A) | (uint32_t)(B) << 8 | (uint32_t)(C) << 16 | (uint32_t)(D) << 24)
+
+/* MagicaVoxel files are z-up, the octree is y-up: vox (x, y, z) maps to svo (x, z, y) */
+
+typedef struct vox_chunk_t
+{
+    uint32_t id;
+    uint32_t content;
+    uint32_t children;
+} vox_chunk_t;
+
+typedef struct vox_layout_t
+{
+    point_t extent;
+    int64_t voxels_offset;
+    uint32_t voxels_count;
+    color_t palette[VOX_PALETTE_SIZE];
+} vox_layout_t;
+
+typedef struct vox_writer_t
+{
+    FILE *file;
+    point_t extent;
+    uint32_t count;
+    color_t palette[VOX_PALETTE_SIZE];
+    uint32_t palette_count;
+    color_t last_color;
+    uint8_t last_index;
+    bool ok;
+} vox_writer_t;
+
+typedef struct raw_writer_t
+{
+    FILE *file;
+    point_t extent;
+    uint8_t *row;
+    bool ok;
+} raw_writer_t;
+
+static inline bool read_u32(FILE *const file, uint32_t *const value)
+{
+    uint8_t bytes[4];
+    if (fread(bytes, 1, 4, file) != 4)
+        return false;
+    *value = (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+    return true;
+}
+
+/* long is 32 bits on LLP64 Windows, so plain fseek/ftell cannot address files over 2 GiB */
+static inline bool seek_file(FILE *const file, const int64_t offset, const int origin)
+{
+#ifdef _WIN32
+    return _fseeki64(file, offset, origin) == 0;
+#else
+    return fseeko(file, (off_t)offset, origin) == 0;
+#endif
+}
+
+static inline int64_t tell_file(FILE *const file)
+{
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return (int64_t)ftello(file);
+#endif
+}
+
+static inline bool write_u32(FILE *const file, const uint32_t value)
+{
+    const uint8_t bytes[4] = {value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, (value >> 24) & 0xFF};
+    return fwrite(bytes, 1, 4, file) == 4;
+}
+
+static inline bool read_chunk(FILE *const file, vox_chunk_t *const chunk)
+{
+    return read_u32(file, &chunk->id) &&
+           read_u32(file, &chunk->content) &&
+           read_u32(file, &chunk->children);
+}
+
+static inline bool write_chunk(FILE *const file, const uint32_t id, const uint32_t content, const uint32_t children)
+{
+    return write_u32(file, id) &&
+           write_u32(file, content) &&
+           write_u32(file, children);
+}
+
+static inline bool same_color(const color_t a, const color_t b)
+{
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+static inline uint32_t morton_encode(const uint32_t x, const uint32_t y, const uint32_t z)
+{
+    uint32_t code = 0;
+    int8_t bit;
+    for (bit = 7; bit >= 0; bit--)
+    {
+        code = code << 3 |
+               ((x >> bit) & 1) << 2 |
+               ((y >> bit) & 1) << 1 |
+               ((z >> bit) & 1);
+    }
+    return code;
+}
+
+static inline point_t morton_decode(const uint32_t code, const int8_t bits)
+{
+    point_t point = POINT(0, 0, 0);
+    int8_t bit;
+    for (bit = bits - 1; bit >= 0; bit--)
+    {
+        point.x = point.x << 1 | ((code >> (3 * bit + 2)) & 1);
+        point.y = point.y << 1 | ((code >> (3 * bit + 1)) & 1);
+        point.z = point.z << 1 | ((code >> (3 * bit)) & 1);
+    }
+    return point;
+}
+
+static int compare_codes(const void *const a, const void *const b)
+{
+    const uint32_t code_a = *(const uint32_t *)a;
+    const uint32_t code_b = *(const uint32_t *)b;
+    return (code_a > code_b) - (code_a < code_b);
+}
+
+static bool read_vox_layout(FILE *const file, vox_layout_t *const layout)
+{
+    uint32_t magic;
+    uint32_t version;
+    vox_chunk_t chunk;
+    if (read_u32(file, &magic) == false || magic != CHUNK_ID('V', 'O', 'X', ' ') ||
+        read_u32(file, &version) == false ||
+        read_chunk(file, &chunk) == false || chunk.id != CHUNK_ID('M', 'A', 'I', 'N') ||
+        seek_file(file, chunk.content, SEEK_CUR) == false)
+        return false;
+    uint32_t i;
+    for (i = 0; i < VOX_PALETTE_SIZE; i++)
+    {
+        layout->palette[i] = COLOR(i, i, i, 255);
+    }
+    bool has_size = false;
+    bool has_voxels = false;
+    while (read_chunk(file, &chunk))
+    {
+        const int64_t content_offset = tell_file(file);
+        if (content_offset < 0)
+            return false;
+        if (chunk.id == CHUNK_ID('S', 'I', 'Z', 'E') && has_size == false)
+        {
+            uint32_t size[3];
+            if (read_u32(file, size) == false || read_u32(file, size + 1) == false || read_u32(file, size + 2) == false)
+                return false;
+            layout->extent = POINT(size[0], size[2], size[1]);
+            has_size = true;
+        }
+        else if (chunk.id == CHUNK_ID('X', 'Y', 'Z', 'I') && has_voxels == false)
+        {
+            if (chunk.content < 4 || read_u32(file, &layout->voxels_count) == false ||
+                layout->voxels_count > (chunk.content - 4) / 4)
+                return false;
+            layout->voxels_offset = tell_file(file);
+            if (layout->voxels_offset < 0)
+                return false;
+            has_voxels = true;
+        }
+        else if (chunk.id == CHUNK_ID('R', 'G', 'B', 'A'))
+        {
+            uint8_t rgba[VOX_PALETTE_SIZE * 4];
+            if (fread(rgba, 4, VOX_PALETTE_SIZE, file) != VOX_PALETTE_SIZE)
+                return false;
+            for (i = 0; i < VOX_PALETTE_SIZE - 1; i++)
+            {
+                layout->palette[i + 1] = COLOR(rgba[4 * i], rgba[4 * i + 1], rgba[4 * i + 2], rgba[4 * i + 3]);
+            }
+        }
+        if (seek_file(file, content_offset + chunk.content + chunk.children, SEEK_SET) == false)
+            return false;
+    }
+    return has_size && has_voxels;
+}
+
+bool svo_vox_extent(const char *const path, point_t *const extent)
+{
+    FILE *const file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+    vox_layout_t layout;
+    const bool ok = read_vox_layout(file, &layout);
+    fclose(file);
+    if (ok)
+        *extent = layout.extent;
+    return ok;
+}
+
+bool svo_import_vox(svo_t *const svo, const char *const path)
+{
+    FILE *const file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+    vox_layout_t layout;
+    if (read_vox_layout(file, &layout) == false ||
+        seek_file(file, layout.voxels_offset, SEEK_SET) == false)
+    {
+        fclose(file);
+        return false;
+    }
+    const size_t codes_count = (size_t)layout.voxels_count + 1;
+    uint32_t *const codes = codes_count > SIZE_MAX / sizeof(uint32_t) ? NULL : malloc(codes_count * sizeof(uint32_t));
+    if (codes == NULL)
+    {
+        fclose(file);
+        return false;
+    }
+    uint8_t batch[VOX_BATCH * 4];
+    uint32_t count = 0;
+    while (count < layout.voxels_count)
+    {
+        const uint32_t batch_count = layout.voxels_count - count < VOX_BATCH ? layout.voxels_count - count : VOX_BATCH;
+        if (fread(batch, 4, batch_count, file) != batch_count)
+        {
+            free(codes);
+            fclose(file);
+            return false;
+        }
+        uint32_t i;
+        for (i = 0; i < batch_count; i++, count++)
+        {
+            const uint8_t *const voxel = batch + 4 * i;
+            codes[count] = morton_encode(voxel[0], voxel[2], voxel[1]) << 8 | voxel[3];
+        }
+    }
+    fclose(file);
+    qsort(codes, count, sizeof(uint32_t), compare_codes);
+    uint32_t i;
+    for (i = 0; i < count; i++)
+    {
+        svo_set(svo, morton_decode(codes[i] >> 8, 8), layout.palette[codes[i] & 0xFF]);
+    }
+    free(codes);
+    return true;
+}
+
+static inline point_t clip_max(const aabb_t *const aabb, const point_t *const extent)
+{
+    const int32_t x = aabb->point.x + (int32_t)aabb->offset;
+    const int32_t y = aabb->point.y + (int32_t)aabb->offset;
+    const int32_t z = aabb->point.z + (int32_t)aabb->offset;
+    return POINT(x < extent->x ? x : extent->x,
+                 y < extent->y ? y : extent->y,
+                 z < extent->z ? z : extent->z);
+}
+
+static void count_voxels(const voxel_t *const voxel, void *const context)
+{
+    vox_writer_t *const writer = context;
+    const point_t min = voxel->aabb.point;
+    const point_t max = clip_max(&voxel->aabb, &writer->extent);
+    if (max.x > min.x && max.y > min.y && max.z > min.z)
+        writer->count += (uint32_t)(max.x - min.x) * (max.y - min.y) * (max.z - min.z);
+    return;
+}
+
+static uint8_t find_palette_index(vox_writer_t *const writer, const color_t color)
+{
+    if (writer->last_index != 0 && same_color(writer->last_color, color))
+        return writer->last_index;
+    uint32_t best = 0;
+    uint32_t best_distance = UINT32_MAX;
+    uint32_t i;
+    for (i = 1; i <= writer->palette_count; i++)
+    {
+        const color_t entry = writer->palette[i];
+        if (same_color(entry, color))
+        {
+            best = i;
+            best_distance = 0;
+            break;
+        }
+        const int32_t dr = entry.r - color.r;
+        const int32_t dg = entry.g - color.g;
+        const int32_t db = entry.b - color.b;
+        const int32_t da = entry.a - color.a;
+        const uint32_t distance = dr * dr + dg * dg + db * db + da * da;
+        if (distance < best_distance)
+        {
+            best = i;
+            best_distance = distance;
+        }
+    }
+    if (best_distance != 0 && writer->palette_count < VOX_PALETTE_SIZE - 1)
+    {
+        best = ++writer->palette_count;
+        writer->palette[best] = color;
+    }
+    writer->last_color = color;
+    writer->last_index = best;
+    return best;
+}
+
+static void write_vox_voxels(const voxel_t *const voxel, void *const context)
+{
+    vox_writer_t *const writer = context;
+    if (writer->ok == false)
+        return;
+    const point_t min = voxel->aabb.point;
+    const point_t max = clip_max(&voxel->aabb, &writer->extent);
+    const uint8_t index = find_palette_index(writer, voxel->color);
+    int32_t x, y, z;
+    for (x = min.x; x < max.x; x++)
+    {
+        for (y = min.y; y < max.y; y++)
+        {
+            for (z = min.z; z < max.z; z++)
+            {
+                const uint8_t bytes[4] = {x, z, y, index};
+                if (fwrite(bytes, 1, 4, writer->file) != 4)
+                {
+                    writer->ok = false;
+                    return;
+                }
+            }
+        }
+    }
+    return;
+}
+
+bool svo_export_vox(const svo_t *const svo, const char *const path)
+{
+    if (svo->extent.x > VOX_MAX_SIZE || svo->extent.y > VOX_MAX_SIZE || svo->extent.z > VOX_MAX_SIZE)
+        return false;
+    vox_writer_t writer = {.file = NULL, .extent = svo->extent, .count = 0, .palette_count = 0, .last_index = 0, .ok = true};
+    svo_walk(svo, count_voxels, &writer);
+    writer.file = fopen(path, "wb");
+    if (writer.file == NULL)
+        return false;
+    const uint32_t size_bytes = 12 + 12;
+    const uint32_t voxels_bytes = 12 + 4 + 4 * writer.count;
+    const uint32_t palette_bytes = 12 + 4 * VOX_PALETTE_SIZE;
+    writer.ok = write_u32(writer.file, CHUNK_ID('V', 'O', 'X', ' ')) &&
+                write_u32(writer.file, VOX_VERSION) &&
+                write_chunk(writer.file, CHUNK_ID('M', 'A', 'I', 'N'), 0, size_bytes + voxels_bytes + palette_bytes) &&
+                write_chunk(writer.file, CHUNK_ID('S', 'I', 'Z', 'E'), 12, 0) &&
+                write_u32(writer.file, svo->extent.x) &&
+                write_u32(writer.file, svo->extent.z) &&
+                write_u32(writer.file, svo->extent.y) &&
+                write_chunk(writer.file, CHUNK_ID('X', 'Y', 'Z', 'I'), 4 + 4 * writer.count, 0) &&
+                write_u32(writer.file, writer.count);
+    if (writer.ok)
+        svo_walk(svo, write_vox_voxels, &writer);
+    if (writer.ok)
+        writer.ok = write_chunk(writer.file, CHUNK_ID('R', 'G', 'B', 'A'), 4 * VOX_PALETTE_SIZE, 0);
+    uint32_t i;
+    for (i = 1; i <= VOX_PALETTE_SIZE && writer.ok; i++)
+    {
+        const color_t color = i < VOX_PALETTE_SIZE ? writer.palette[i] : COLOR(0, 0, 0, 0);
+        const uint8_t bytes[4] = {color.r, color.g, color.b, color.a};
+        writer.ok = fwrite(bytes, 1, 4, writer.file) == 4;
+    }
+    return fclose(writer.file) == 0 && writer.ok;
+}
+
+bool svo_import_raw(svo_t *const svo, const char *const path, const point_t extent)
+{
+    /* Voxels outside the tree would be dropped by svo_set, so refuse the grid instead */
+    if (extent.x <= 0 || extent.y <= 0 || extent.z <= 0 ||
+        extent.x > svo->extent.x || extent.y > svo->extent.y || extent.z > svo->extent.z)
+        return false;
+    FILE *const file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+    const size_t plane_bytes = (size_t)extent.x * extent.y * 4;
+    uint8_t *const slab = malloc(RAW_BRICK * plane_bytes);
+    if (slab == NULL)
+    {
+        fclose(file);
+        return false;
+    }
+    int32_t slab_z;
+    for (slab_z = 0; slab_z < extent.z; slab_z += RAW_BRICK)
+    {
+        const int32_t depth = extent.z - slab_z < RAW_BRICK ? extent.z - slab_z : RAW_BRICK;
+        if (fread(slab, plane_bytes, depth, file) != (size_t)depth)
+        {
+            free(slab);
+            fclose(file);
+            return false;
+        }
+        int32_t brick_x, brick_y;
+        for (brick_x = 0; brick_x < extent.x; brick_x += RAW_BRICK)
+        {
+            for (brick_y = 0; brick_y < extent.y; brick_y += RAW_BRICK)
+            {
+                uint32_t code;
+                for (code = 0; code < RAW_BRICK * RAW_BRICK * RAW_BRICK; code++)
+                {
+                    const point_t offset = morton_decode(code, 3);
+                    const point_t point = POINT(brick_x + offset.x, brick_y + offset.y, slab_z + offset.z);
+                    if (point.x >= extent.x || point.y >= extent.y || offset.z >= depth)
+                        continue;
+                    const uint8_t *const rgba = slab + offset.z * plane_bytes + ((size_t)point.y * extent.x + point.x) * 4;
+                    if (rgba[3] != 0)
+                        svo_set(svo, point, COLOR(rgba[0], rgba[1], rgba[2], rgba[3]));
+                }
+            }
+        }
+    }
+    free(slab);
+    fclose(file);
+    return true;
+}
+
+static void write_raw_voxels(const voxel_t *const voxel, void *const context)
+{
+    raw_writer_t *const writer = context;
+    if (writer->ok == false)
+        return;
+    const point_t min = voxel->aabb.point;
+    const point_t max = clip_max(&voxel->aabb, &writer->extent);
+    if (max.x <= min.x || max.y <= min.y || max.z <= min.z)
+        return;
+    int32_t x, y, z;
+    for (x = 0; x < max.x - min.x; x++)
+    {
+        memcpy(writer->row + 4 * x, (uint8_t[4]){voxel->color.r, voxel->color.g, voxel->color.b, voxel->color.a}, 4);
+    }
+    for (z = min.z; z < max.z; z++)
+    {
+        for (y = min.y; y < max.y; y++)
+        {
+            const int64_t offset = (((int64_t)z * writer->extent.y + y) * writer->extent.x + min.x) * 4;
+            if (seek_file(writer->file, offset, SEEK_SET) == false ||
+                fwrite(writer->row, 4, max.x - min.x, writer->file) != (size_t)(max.x - min.x))
+            {
+                writer->ok = false;
+                return;
+            }
+        }
+    }
+    return;
+}
+
+bool svo_export_raw(const svo_t *const svo, const char *const path)
+{
+    raw_writer_t writer = {.file = fopen(path, "wb"), .extent = svo->extent, .ok = true};
+    if (writer.file == NULL)
+        return false;
+    writer.row = calloc(svo->extent.x, 4);
+    if (writer.row == NULL)
+    {
+        fclose(writer.file);
+        return false;
+    }
+    int64_t row;
+    for (row = 0; row < (int64_t)svo->extent.y * svo->extent.z && writer.ok; row++)
+    {
+        writer.ok = fwrite(writer.row, 4, svo->extent.x, writer.file) == (size_t)svo->extent.x;
+    }
+    if (writer.ok)
+        svo_walk(svo, write_raw_voxels, &writer);
+    free(writer.row);
+    return fclose(writer.file) == 0 && writer.ok;
+}
@@ -0,0 +1,227 @@
+#include "svo_voxelize.h"
+#include <math.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OVERLAP_EPSILON 1e-4f
+#define CENTER_JITTER_X 0.0137f
+#define CENTER_JITTER_Y 0.0291f
+#define CENTER_JITTER_Z 0.0413f
+
+typedef struct cell_t
+{
+    aabb_t aabb;
+    uint32_t depth;
+    uint32_t *triangles;
+    uint32_t count;
+    bool inside;
+} cell_t;
+
+static inline void sub3(float *const result, const float *const a, const float *const b)
+{
+    result[0] = a[0] - b[0];
+    result[1] = a[1] - b[1];
+    result[2] = a[2] - b[2];
+    return;
+}
+
+static inline void cross3(float *const result, const float *const a, const float *const b)
+{
+    result[0] = a[1] * b[2] - a[2] * b[1];
+    result[1] = a[2] * b[0] - a[0] * b[2];
+    result[2] = a[0] * b[1] - a[1] * b[0];
+    return;
+}
+
+static inline float dot3(const float *const a, const float *const b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline bool separated_on_axis(const float *const axis, const float (*const v)[3], const float *const half)
+{
+    const float p0 = dot3(axis, v[0]);
+    const float p1 = dot3(axis, v[1]);
+    const float p2 = dot3(axis, v[2]);
+    const float r = half[0] * fabsf(axis[0]) + half[1] * fabsf(axis[1]) + half[2] * fabsf(axis[2]);
+    const float min = fminf(p0, fminf(p1, p2));
+    const float max = fmaxf(p0, fmaxf(p1, p2));
+    return min > r || max < -r;
+}
+
+static bool triangle_overlaps_box(const triangle_t *const triangle, const aabb_t *const aabb)
+{
+    const float half_size = aabb->offset * 0.5f + OVERLAP_EPSILON;
+    const float half[3] = {half_size, half_size, half_size};
+    const float center[3] = {aabb->point.x + aabb->offset * 0.5f,
+                             aabb->point.y + aabb->offset * 0.5f,
+                             aabb->point.z + aabb->offset * 0.5f};
+    float v[3][3];
+    int8_t i, j;
+    for (i = 0; i < 3; i++)
+    {
+        sub3(v[i], triangle->vertices[i], center);
+    }
+    for (i = 0; i < 3; i++)
+    {
+        const float min = fminf(v[0][i], fminf(v[1][i], v[2][i]));
+        const float max = fmaxf(v[0][i], fmaxf(v[1][i], v[2][i]));
+        if (min > half[i] || max < -half[i])
+            return false;
+    }
+    float edges[3][3];
+    sub3(edges[0], v[1], v[0]);
+    sub3(edges[1], v[2], v[1]);
+    sub3(edges[2], v[0], v[2]);
+    float normal[3];
+    cross3(normal, edges[0], edges[1]);
+    if (separated_on_axis(normal, (const float(*)[3])v, half))
+        return false;
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            const float unit[3] = {i == 0, i == 1, i == 2};
+            float axis[3];
+            cross3(axis, unit, edges[j]);
+            if (separated_on_axis(axis, (const float(*)[3])v, half))
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool segment_crosses_triangle(const float *const from, const float *const direction, const float max_t, const triangle_t *const triangle)
+{
+    float edge_1[3], edge_2[3], p[3], t[3], q[3];
+    sub3(edge_1, triangle->vertices[1], triangle->vertices[0]);
+    sub3(edge_2, triangle->vertices[2], triangle->vertices[0]);
+    cross3(p, direction, edge_2);
+    const float determinant = dot3(edge_1, p);
+    if (fabsf(determinant) < 1e-12f)
+        return false;
+    const float inv_determinant = 1.0f / determinant;
+    sub3(t, from, triangle->vertices[0]);
+    const float u = dot3(t, p) * inv_determinant;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+    cross3(q, t, edge_1);
+    const float v = dot3(direction, q) * inv_determinant;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+    const float distance = dot3(edge_2, q) * inv_determinant;
+    return distance >= 0.0f && distance < max_t;
+}
+
+static inline void cell_center(float *const center, const aabb_t *const aabb)
+{
+    center[0] = aabb->point.x + aabb->offset * (0.5f + CENTER_JITTER_X);
+    center[1] = aabb->point.y + aabb->offset * (0.5f + CENTER_JITTER_Y);
+    center[2] = aabb->point.z + aabb->offset * (0.5f + CENTER_JITTER_Z);
+    return;
+}
+
+static bool crossing_parity(const float *const from,
+                            const float *const to,
+                            const triangle_t *const triangles,
+                            const uint32_t *const indexes,
+                            const uint32_t count)
+{
+    float direction[3];
+    sub3(direction, to, from);
+    bool parity = false;
+    uint32_t i;
+    for (i = 0; i < count; i++)
+    {
+        const uint32_t index = indexes != NULL ? indexes[i] : i;
+        if (segment_crosses_triangle(from, direction, 1.0f, triangles + index))
+            parity = !parity;
+    }
+    return parity;
+}
+
+static inline void fill_cell(svo_t *const svo, const cell_t *const cell, const triangle_t *const triangles, const bool fill_solid, const color_t fill_color)
+{
+    if (cell->count != 0)
+        svo_fill(svo, cell->aabb, triangles[cell->triangles[0]].color);
+    else if (fill_solid && cell->inside)
+        svo_fill(svo, cell->aabb, fill_color);
+    return;
+}
+
+void svo_voxelize(svo_t *const svo,
+                  const triangle_t *const triangles,
+                  const uint32_t count,
+                  const bool fill_solid,
+                  const color_t fill_color)
+{
+    cell_t *const stack = malloc((7 * svo->max_depth + 1) * sizeof(cell_t));
+    assert(stack != 0);
+    const aabb_t root = AABB(POINT(0, 0, 0), svo->grid_size);
+    uint32_t *const root_triangles = malloc((count + 1) * sizeof(uint32_t));
+    assert(root_triangles != 0);
+    uint32_t root_count = 0;
+    float min_x = 0.0f;
+    uint32_t i;
+    for (i = 0; i < count; i++)
+    {
+        if (triangle_overlaps_box(triangles + i, &root))
+            root_triangles[root_count++] = i;
+        min_x = fminf(min_x, fminf(triangles[i].vertices[0][0], fminf(triangles[i].vertices[1][0], triangles[i].vertices[2][0])));
+    }
+    float root_center[3];
+    cell_center(root_center, &root);
+    const float outside[3] = {min_x - 1.0f, root_center[1], root_center[2]};
+    stack[0] = (cell_t){.aabb = root,
+                        .depth = 0,
+                        .triangles = root_triangles,
+                        .count = root_count,
+                        .inside = fill_solid && crossing_parity(outside, root_center, triangles, NULL, count)};
+    uint32_t stack_size = 1;
+    while (stack_size > 0)
+    {
+        cell_t cell = stack[--stack_size];
+        if (cell.depth == svo->max_depth || cell.count == 0)
+        {
+            fill_cell(svo, &cell, triangles, fill_solid, fill_color);
+            free(cell.triangles);
+            continue;
+        }
+        float center[3];
+        cell_center(center, &cell.aabb);
+        const uint32_t half = cell.aabb.offset / 2;
+        int8_t octant;
+        for (octant = 7; octant >= 0; octant--)
+        {
+            cell_t child = {.aabb = AABB(POINT(cell.aabb.point.x + ((octant & 4) ? half : 0),
+                                               cell.aabb.point.y + ((octant & 2) ? half : 0),
+                                               cell.aabb.point.z + ((octant & 1) ? half : 0)),
+                                         half),
+                            .depth = cell.depth + 1,
+                            .count = 0};
+            if (child.aabb.point.x >= svo->extent.x ||
+                child.aabb.point.y >= svo->extent.y ||
+                child.aabb.point.z >= svo->extent.z)
+                continue;
+            child.triangles = malloc((cell.count + 1) * sizeof(uint32_t));
+            assert(child.triangles != 0);
+            for (i = 0; i < cell.count; i++)
+            {
+                if (triangle_overlaps_box(triangles + cell.triangles[i], &child.aabb))
+                    child.triangles[child.count++] = cell.triangles[i];
+            }
+            child.inside = false;
+            if (fill_solid)
+            {
+                float child_center[3];
+                cell_center(child_center, &child.aabb);
+                child.inside = cell.inside ^ crossing_parity(center, child_center, triangles, cell.triangles, cell.count);
+            }
+            stack[stack_size++] = child;
+        }
+        free(cell.triangles);
+    }
+    free(stack);
+    return;
+}
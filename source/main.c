@@ -1,16 +1,21 @@
 #include "vector.h"
 #include "rbt_map.h"
 #include "hash_map.h"
+#include "hash_map_io.h"
 #include "queue.h"
 #include "dequeue.h"
 #include "util_funcs.h"
 #include "bit_types.h"
 #include "string_type.h"
 #include "shared_ptr.h"
+#include "concurrent_hash_map.h"
+#include "atomic_hash_map.h"
 #include <svo.h>
+#include <brickmap.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <pthread.h>
 
 #define N 50
 
@@ -19,6 +24,10 @@ void map_test(void);
 void unordered_map_test(void);
 void queue_test(void);
 void dequeue_test(void);
+void brickmap_test(void);
+void atomic_hash_map_test(void);
+void hash_map_churn_test(void);
+void hash_map_persist_test(void);
 
 #define CYC 1000000000
 int main(void)
@@ -52,6 +61,10 @@ int main(void)
     //    queue_test();
     //    unordered_map_test();
     //    vector_test();
+    //    brickmap_test();
+    //    atomic_hash_map_test();
+    //    hash_map_churn_test();
+    //    hash_map_persist_test();
     printf("Done\n");
     return 1;
 }
@@ -202,3 +215,365 @@ void vector_test(void)
 
     return;
 }
+
+void brickmap_test(void)
+{
+    const int32_t size = 128;
+    const uint32_t lookups = 1000000;
+    const uint32_t rays = 20000;
+    const float fill_ratios[] = {0.01f, 0.1f, 0.5f};
+    uint32_t f;
+    for (f = 0; f < sizeof(fill_ratios) / sizeof(fill_ratios[0]); f++)
+    {
+        svo_t ot = svo(size, 1);
+        brickmap_t bm = brickmap(POINT(size, size, size));
+        srand(1);
+        const uint32_t fill = fill_ratios[f] * size * size * size;
+        uint32_t i;
+        for (i = 0; i < fill; i++)
+        {
+            const point_t point = POINT(rand() % size, rand() % size, rand() % size);
+            const color_t color = COLOR(rand() % 4, 0, 0, 255);
+            svo_set(&ot, point, color);
+            brickmap_set(&bm, point, color);
+        }
+        svo_optimize(&ot);
+
+        uint32_t svo_found = 0;
+        uint32_t brickmap_found = 0;
+        srand(2);
+        clock_t begin = clock();
+        for (i = 0; i < lookups; i++)
+        {
+            svo_found += svo_get(&ot, POINT(rand() % size, rand() % size, rand() % size)).aabb.offset != 0;
+        }
+        const double svo_get_time = (double)(clock() - begin) / CLOCKS_PER_SEC;
+        srand(2);
+        begin = clock();
+        for (i = 0; i < lookups; i++)
+        {
+            brickmap_found += brickmap_get(&bm, POINT(rand() % size, rand() % size, rand() % size)).aabb.offset != 0;
+        }
+        const double brickmap_get_time = (double)(clock() - begin) / CLOCKS_PER_SEC;
+
+        uint32_t svo_hits = 0;
+        uint32_t brickmap_hits = 0;
+        srand(3);
+        begin = clock();
+        for (i = 0; i < rays; i++)
+        {
+            const point_t start = POINT(rand() % size, rand() % size, rand() % size);
+            const point_t end = POINT(rand() % size, rand() % size, rand() % size);
+            svo_hits += svo_ray_cast(&ot, start, end, 2.0f * size).hit;
+        }
+        const double svo_ray_time = (double)(clock() - begin) / CLOCKS_PER_SEC;
+        srand(3);
+        begin = clock();
+        for (i = 0; i < rays; i++)
+        {
+            const point_t start = POINT(rand() % size, rand() % size, rand() % size);
+            const point_t end = POINT(rand() % size, rand() % size, rand() % size);
+            brickmap_hits += brickmap_ray_cast(&bm, start, end, 2.0f * size).hit;
+        }
+        const double brickmap_ray_time = (double)(clock() - begin) / CLOCKS_PER_SEC;
+
+        printf("Fill %.2f | get: svo %.3fs, brickmap %.3fs (%u/%u found) | ray: svo %.3fs, brickmap %.3fs (%u/%u hits)\n",
+               fill_ratios[f],
+               svo_get_time,
+               brickmap_get_time,
+               svo_found,
+               brickmap_found,
+               svo_ray_time,
+               brickmap_ray_time,
+               svo_hits,
+               brickmap_hits);
+        brickmap_free(&bm);
+        svo_free(&ot);
+    }
+    return;
+}
+
+typedef struct session_t
+{
+    uint64_t last_seen;
+    uint32_t requests;
+    uint32_t flags;
+} session_t;
+
+static void *t_at_session(const void *const src, const size_t index)
+{
+    return ((session_t *)src) + index;
+}
+
+static int t_cmp_session(const void *const src_1, const void *const src_2)
+{
+    const session_t *a = src_1;
+    const session_t *b = src_2;
+    if (a->last_seen != b->last_seen)
+        return a->last_seen > b->last_seen ? 1 : -1;
+    if (a->requests != b->requests)
+        return a->requests > b->requests ? 1 : -1;
+    return a->flags > b->flags ? 1 : (a->flags < b->flags ? -1 : 0);
+}
+
+static void *t_cpy_session(void *const dest, const void *const src)
+{
+    *(session_t *)dest = *(session_t *)src;
+    return dest;
+}
+
+static void t_free_session(void *const src)
+{
+    *(session_t *)src = (session_t){0};
+    return;
+}
+
+static size_t t_hash_session(const void *const src)
+{
+    const session_t *session = src;
+    return hash_64bit(session->last_seen) ^ hash_64bit((uint64_t)session->requests << 32 | session->flags);
+}
+
+static void t_swap_session(void *const src_1, void *const src_2)
+{
+    session_t tmp = *(session_t *)src_1;
+    *(session_t *)src_1 = *(session_t *)src_2;
+    *(session_t *)src_2 = tmp;
+    return;
+}
+
+typedef struct map_bench_t
+{
+    int kind;
+    pthread_mutex_t *lock;
+    hash_map locked;
+    concurrent_hash_map sharded;
+    atomic_hash_map lock_free;
+    uint64_t keys;
+    uint32_t ops;
+    uint32_t seed;
+    uint32_t found;
+} map_bench_t;
+
+/* xorshift64: full 64-bit keys on every target, rand() stops at 32767 on MinGW */
+static inline uint64_t next_random(uint64_t *const state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void *map_bench_worker(void *const context)
+{
+    map_bench_t *const bench = context;
+    uint64_t state = bench->seed * 0x9E3779B97F4A7C15ull + 1;
+    uint32_t i;
+    for (i = 0; i < bench->ops; i++)
+    {
+        const uint64_t key = next_random(&state) % bench->keys;
+        session_t session = {.last_seen = i, .requests = 1, .flags = 0};
+        /* 90% lookups, 10% updates */
+        const int write = (state >> 32) % 10 == 0;
+        if (bench->kind == 0)
+        {
+            pthread_mutex_lock(bench->lock);
+            if (write)
+                set_hash_map(bench->locked, &key, &session);
+            else
+                bench->found += get_hash_map(bench->locked, &key, &session);
+            pthread_mutex_unlock(bench->lock);
+        }
+        else if (bench->kind == 1)
+        {
+            if (write)
+                set_concurrent_hash_map(bench->sharded, &key, &session);
+            else
+                bench->found += get_concurrent_hash_map(bench->sharded, &key, &session);
+        }
+        else
+        {
+            if (write)
+                set_atomic_hash_map(bench->lock_free, key, &session);
+            else
+                bench->found += get_atomic_hash_map(bench->lock_free, key, &session);
+        }
+    }
+    return NULL;
+}
+
+void atomic_hash_map_test(void)
+{
+    const uint64_t keys = 1000000;
+    const uint32_t ops = 2000000;
+    const uint32_t thread_counts[] = {1, 2, 4, 8, 16, 32};
+    const char *const names[] = {"mutex hash_map", "concurrent_hash_map", "atomic_hash_map"};
+    const type_func session_type = {.t_size = sizeof(session_t),
+                                    .t_at = t_at_session,
+                                    .t_cmp = t_cmp_session,
+                                    .t_cpy = t_cpy_session,
+                                    .t_move = t_cpy_session,
+                                    .t_free = t_free_session,
+                                    .t_hash = t_hash_session,
+                                    .t_swap = t_swap_session};
+    uint32_t t;
+    for (t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++)
+    {
+        const uint32_t threads = thread_counts[t];
+        int kind;
+        for (kind = 0; kind < 3; kind++)
+        {
+            pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+            hash_map locked = NULL;
+            concurrent_hash_map sharded = NULL;
+            atomic_hash_map lock_free = NULL;
+            if (kind == 0)
+                locked = create_hash_map(keys, f_uint64_t, &session_type);
+            else if (kind == 1)
+                sharded = create_concurrent_hash_map(keys, 0, f_uint64_t, &session_type);
+            else
+                lock_free = create_atomic_hash_map(keys, sizeof(session_t));
+            map_bench_t *const benches = malloc(threads * sizeof(map_bench_t));
+            pthread_t *const workers = malloc(threads * sizeof(pthread_t));
+            struct timespec begin, end;
+            clock_gettime(CLOCK_MONOTONIC, &begin);
+            uint32_t i;
+            for (i = 0; i < threads; i++)
+            {
+                benches[i] = (map_bench_t){.kind = kind,
+                                           .lock = &lock,
+                                           .locked = locked,
+                                           .sharded = sharded,
+                                           .lock_free = lock_free,
+                                           .keys = keys,
+                                           .ops = ops / threads,
+                                           .seed = i + 1,
+                                           .found = 0};
+                pthread_create(workers + i, NULL, map_bench_worker, benches + i);
+            }
+            uint32_t found = 0;
+            for (i = 0; i < threads; i++)
+            {
+                pthread_join(workers[i], NULL);
+                found += benches[i].found;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            const double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) * 1e-9;
+            printf("Threads %2u | %-19s %.3fs, %.1f Mops/s (%u found)\n",
+                   threads,
+                   names[kind],
+                   seconds,
+                   ops / seconds * 1e-6,
+                   found);
+            free(workers);
+            free(benches);
+            free_hash_map(locked);
+            free_concurrent_hash_map(sharded);
+            free_atomic_hash_map(lock_free);
+        }
+    }
+    return;
+}
+
+void hash_map_churn_test(void)
+{
+    const uint64_t live = 500000;
+    const uint32_t rounds = 4000000;
+    const uint32_t lookups = 4000000;
+    const char *const names[] = {"group probing", "robin hood"};
+    int robin_hood;
+    for (robin_hood = 0; robin_hood < 2; robin_hood++)
+    {
+        hash_map m = create_hash_map(live, f_uint64_t, f_uint64_t);
+        set_robin_hood_hash_map(m, robin_hood);
+        /* Live keys are always the window [first, first + live) */
+        uint64_t first = 0;
+        uint64_t key;
+        for (key = 0; key < live; key++)
+        {
+            set_hash_map(m, &key, &key);
+        }
+        clock_t begin = clock();
+        uint32_t i;
+        for (i = 0; i < rounds; i++)
+        {
+            key = first++;
+            delete_hash_map(m, &key, NULL);
+            key = first + live - 1;
+            set_hash_map(m, &key, &key);
+        }
+        const double churn_time = (double)(clock() - begin) / CLOCKS_PER_SEC;
+        uint64_t found = 0;
+        uint64_t state = 1;
+        begin = clock();
+        for (i = 0; i < lookups; i++)
+        {
+            /* Half hits, half misses */
+            key = first + next_random(&state) % (2 * live);
+            uint64_t val;
+            found += get_hash_map(m, &key, &val);
+        }
+        const double lookup_time = (double)(clock() - begin) / CLOCKS_PER_SEC;
+        const hash_map_stats_t stats = stats_hash_map(m);
+        printf("%-13s | churn %.3fs, lookup %.3fs (%lu found) | probe avg %.2f max %zu, tombstones %zu, load %.2f\n",
+               names[robin_hood],
+               churn_time,
+               lookup_time,
+               (unsigned long)found,
+               stats.average_probe,
+               stats.max_probe,
+               stats.tombstones,
+               stats.load_factor);
+        free_hash_map(m);
+    }
+    return;
+}
+
+void hash_map_persist_test(void)
+{
+    const uint64_t count = 4000000;
+    const uint32_t lookups = 4000000;
+    const char *const path = "hash_map.bin";
+    clock_t begin = clock();
+    hash_map m = create_hash_map(count, f_uint64_t, f_uint64_t);
+    uint64_t key;
+    for (key = 0; key < count; key++)
+    {
+        uint64_t val = key * 2;
+        set_hash_map(m, &key, &val);
+    }
+    const double build_time = (double)(clock() - begin) / CLOCKS_PER_SEC;
+    begin = clock();
+    int saved = save_hash_map(m, path);
+    const double save_time = (double)(clock() - begin) / CLOCKS_PER_SEC;
+    free_hash_map(m);
+    begin = clock();
+    hash_map mapped = map_hash_map(path, f_uint64_t, f_uint64_t, 0);
+    const double map_time = (double)(clock() - begin) / CLOCKS_PER_SEC;
+    if (saved == 0 || mapped == NULL)
+    {
+        printf("persist failed\n");
+        free_hash_map(mapped);
+        return;
+    }
+    uint64_t found = 0;
+    uint64_t state = 1;
+    begin = clock();
+    uint32_t i;
+    for (i = 0; i < lookups; i++)
+    {
+        uint64_t val;
+        key = next_random(&state) % (2 * count);
+        found += get_hash_map(mapped, &key, &val) && val == key * 2;
+    }
+    const double lookup_time = (double)(clock() - begin) / CLOCKS_PER_SEC;
+    printf("build %.3fs, save %.3fs, map %.6fs, first lookups %.3fs (%lu found)\n",
+           build_time,
+           save_time,
+           map_time,
+           lookup_time,
+           (unsigned long)found);
+    free_hash_map(mapped);
+    remove(path);
+    return;
+}
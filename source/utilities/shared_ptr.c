@@ -55,7 +55,7 @@ shared_ptr realloc_shared_ptr(shared_ptr const ptr, const size_t size, const siz
 
 void free_shared_ptr(shared_ptr const ptr)
 {
-    if (ptr != NULL && --ptr->count == 0)
+    if (ptr != NULL && __atomic_sub_fetch(&ptr->count, 1, __ATOMIC_ACQ_REL) == 0)
     {
         if (ptr->data != NULL)
             free(ptr->data);
@@ -68,7 +68,7 @@ void free_shared_ptr(shared_ptr const ptr)
 size_t count_shared_ptr(shared_ptr const ptr)
 {
     if (ptr != NULL)
-        return ptr->count;
+        return __atomic_load_n(&ptr->count, __ATOMIC_ACQUIRE);
     else
         return 0;
 }
@@ -85,6 +85,6 @@ shared_ptr copy_shared_ptr(shared_ptr const ptr)
 {
     if (ptr == NULL)
         return NULL;
-    ++ptr->count;
+    __atomic_add_fetch(&ptr->count, 1, __ATOMIC_RELAXED);
     return ptr;
 }
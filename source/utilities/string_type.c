@@ -1,4 +1,5 @@
 #include "string_type.h"
+#include "util_funcs.h"
 #include <string.h>
 
 string_t create_string(const char *const str)
@@ -23,3 +24,19 @@ void free_string(string_t const str)
     free_shared_ptr(str);
     return;
 }
+
+/* Compares a string_t with a string_view_t the way strcmp would */
+int cmp_string_view(const void *const str, const void *const view)
+{
+    const char *a = get_string(*(const string_t *)str);
+    const string_view_t *b = view;
+    int result = strncmp(a, b->str, b->len);
+    if (result != 0)
+        return result;
+    return a[strnlen(a, b->len)] != '\0';
+}
+
+size_t hash_string_view(const string_view_t *const view)
+{
+    return hash_string_len(view->str, view->len);
+}
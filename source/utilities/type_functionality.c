@@ -38,6 +38,12 @@ size_t t_hash_string_t(const void *const src)
     return hash_string_t(get_string(*(string_t *)src));
 }
 
+size_t t_hash_seed_string_t(const void *const src, const size_t seed)
+{
+    const char *str = get_string(*(string_t *)src);
+    return hash_bytes(str, strlen(str), seed);
+}
+
 /* Swap functions */
 void t_swap_8bit(void *const src_1, void *const src_2)
 {
@@ -617,7 +623,8 @@ const type_func orig_f_string_t = {
     .t_move = t_move_string_t,
     .t_free = t_free_string_t,
     .t_hash = t_hash_string_t,
-    .t_swap = t_swap_size_t};
+    .t_swap = t_swap_size_t,
+    .t_hash_seed = t_hash_seed_string_t};
 
 const type_func orig_f_float = {
     .t_size = sizeof(float),
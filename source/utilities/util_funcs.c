@@ -1,4 +1,24 @@
 #include "util_funcs.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+/* wyhash constants */
+#define HASH_P0 0xA0761D6478BD642Full
+#define HASH_P1 0xE7037ED1A0B428DBull
+#define HASH_P2 0x8EBC6AF09C88C6E3ull
+#define HASH_P3 0x589965CC75374CC3ull
+
+/* Fixed by default so stored hashes stay valid across runs */
+static uint64_t hash_seed = HASH_P3;
+static uint64_t hash_seed_counter = 0;
+
+static inline uint64_t mix_hash(const uint64_t a, const uint64_t b);
+static inline uint64_t read_64(const uint8_t *const p);
+static inline uint64_t read_32(const uint8_t *const p);
 
 size_t next_power_of_2(size_t num)
 {
@@ -6,10 +26,6 @@ size_t next_power_of_2(size_t num)
     {
         return 2;
     }
-    else if (num % 2 == 0)
-    {
-        return num;
-    }
     else
     {
         --num;
@@ -29,25 +45,20 @@ size_t calculate_padding(size_t currenaddres, size_t data_size)
     return offset - currenaddres;
 }
 
+/* Small integers are widened first so the result uses every bit of size_t */
 size_t hash_8bit(uint8_t x)
 {
-    x = ((x >> 3) ^ x) * 0x1D;
-    x = ((x >> 5) ^ x) * 0x35;
-    return x;
+    return hash_size_t(x);
 }
 
 size_t hash_16bit(uint16_t x)
 {
-    x = ((x >> 8) ^ x) * 0x88CC;
-    x = ((x >> 7) ^ x) * 0x119D;
-    return x;
+    return hash_size_t(x);
 }
 
 size_t hash_32bit(uint32_t x)
 {
-    x = ((x >> 16) ^ x) * 0x45D9F3B;
-    x = ((x >> 16) ^ x) * 0x45D9F3B;
-    return x ^ (x >> 16);
+    return hash_size_t(x);
 }
 
 size_t hash_64bit(uint64_t x)
@@ -72,12 +83,125 @@ size_t hash_size_t(size_t x)
 
 size_t hash_string_t(const char *key)
 {
-    /* sdbm */
-    size_t hash = 0;
-    size_t c;
-    while ((c = *key++))
+    return hash_string_len(key, strlen(key));
+}
+
+size_t hash_string_len(const char *key, const size_t len)
+{
+    return hash_bytes(key, len, hash_seed);
+}
+
+/* wyhash: 8 bytes per step, three independent multiply lanes for keys over 48 bytes */
+uint64_t hash_bytes(const void *const key, const size_t len, uint64_t seed)
+{
+    const uint8_t *p = key;
+    uint64_t a = 0;
+    uint64_t b = 0;
+    seed ^= mix_hash(seed ^ HASH_P0, HASH_P1);
+    if (len <= 16)
+    {
+        if (len >= 4)
+        {
+            a = (read_32(p) << 32) | read_32(p + ((len >> 3) << 2));
+            b = (read_32(p + len - 4) << 32) | read_32(p + len - 4 - ((len >> 3) << 2));
+        }
+        else if (len > 0)
+        {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+        }
+    }
+    else
     {
-        hash = c + (hash << 6) + (hash << 16) - hash;
+        size_t i = len;
+        if (i > 48)
+        {
+            uint64_t seed_1 = seed;
+            uint64_t seed_2 = seed;
+            do
+            {
+                seed = mix_hash(read_64(p) ^ HASH_P1, read_64(p + 8) ^ seed);
+                seed_1 = mix_hash(read_64(p + 16) ^ HASH_P2, read_64(p + 24) ^ seed_1);
+                seed_2 = mix_hash(read_64(p + 32) ^ HASH_P3, read_64(p + 40) ^ seed_2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= seed_1 ^ seed_2;
+        }
+        while (i > 16)
+        {
+            seed = mix_hash(read_64(p) ^ HASH_P1, read_64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = read_64(p + i - 16);
+        b = read_64(p + i - 8);
     }
-    return hash;
-}
\ No newline at end of file
+    return mix_hash(HASH_P1 ^ len, mix_hash(a ^ HASH_P1, b ^ seed));
+}
+
+/* Call before building any table: stored and cached string hashes depend on it */
+void set_hash_seed(const uint64_t seed)
+{
+    hash_seed = seed;
+    return;
+}
+
+/* A fresh seed per call, for containers that mix their own seed into key hashes */
+size_t random_hash_seed(void)
+{
+    uint64_t local = 0;
+    uint64_t counter = __atomic_add_fetch(&hash_seed_counter, 1, __ATOMIC_RELAXED);
+    return hash_64bit(counter * HASH_P0 ^ (uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)&local);
+}
+
+/* C11 aligned_alloc is missing from msvcrt; the memory must go back through aligned_free */
+void *aligned_malloc(const size_t alignment, const size_t size)
+{
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    void *ptr = NULL;
+    return posix_memalign(&ptr, alignment, size) == 0 ? ptr : NULL;
+#endif
+}
+
+void aligned_free(void *const ptr)
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+    return;
+}
+
+static inline uint64_t mix_hash(const uint64_t a, const uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+    uint64_t ha = a >> 32, la = (uint32_t)a, hb = b >> 32, lb = (uint32_t)b;
+    uint64_t rh = ha * hb, rm_0 = ha * lb, rm_1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm_0 << 32);
+    uint64_t c = t < rl;
+    uint64_t lo = t + (rm_1 << 32);
+    c += lo < t;
+    uint64_t hi = rh + (rm_0 >> 32) + (rm_1 >> 32) + c;
+    return lo ^ hi;
+#endif
+}
+
+static inline uint64_t read_64(const uint8_t *const p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t read_32(const uint8_t *const p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}